@@ -65,6 +65,7 @@ void ApplicationSettingsStorage::load()
         mqttPort = mqtt["port"];
         mqttSensorPfx = (const char *)mqtt["sensorPfx"];
         mqttControllerPfx = (const char *)mqtt["controllerPfx"];
+        mqttAllowList = (const char *)mqtt["allowList"];
 
         cpuBoost = root["cpuBoost"];
         useOwnBaseAddress = root["useOwnBaseAddress"];
@@ -115,6 +116,7 @@ void ApplicationSettingsStorage::save()
     mqtt["port"] = mqttPort;
     mqtt.set("sensorPfx", mqttSensorPfx);
     mqtt.set("controllerPfx", mqttControllerPfx);
+    mqtt.set("allowList", mqttAllowList);
 
     root["cpuBoost"] = cpuBoost;
     root["useOwnBaseAddress"] = useOwnBaseAddress;
@@ -48,6 +48,7 @@ class ApplicationSettingsStorage
     int         mqttPort = 1883;
     String      mqttSensorPfx;
     String      mqttControllerPfx;
+    String      mqttAllowList;
 
     bool        cpuBoost = true;
     bool        useOwnBaseAddress = true;
@@ -15,6 +15,7 @@ void CloudController::begin()
         1000,
         TimerDelegate(&CloudController::oneSecondTimerHandler,
 	              this)).start(true);
+    subscribeEvents();
 }
 
 void CloudController::notifyChange(String object, String value)
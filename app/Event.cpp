@@ -0,0 +1,192 @@
+#include <user_config.h>
+#include <SmingCore/SmingCore.h>
+#include <SmingCore/Debug.h>
+#include <Event.h>
+#include <Logging.h>
+#include <Perf.h>
+
+EventBus Events;
+
+static const char * const topicNames[EVENT_TOPICS] =
+{
+    "io", "sensor", "radioRx", "system"
+};
+
+String IOEvent::getName() const
+{
+    switch (kind)
+    {
+        case IO_DIGITAL_INPUT:
+            return String("inputD") + String(index);
+        case IO_DIGITAL_OUTPUT:
+            return String("outputD") + String(index);
+        case IO_ANALOG_INPUT:
+            return String("inputA") + String(index);
+        case IO_RTC_TEMPERATURE:
+            return "RTC-temperature";
+    }
+    return "unknown";
+}
+
+String IOEvent::getValue() const
+{
+    switch (kind)
+    {
+        case IO_DIGITAL_INPUT:
+        case IO_DIGITAL_OUTPUT:
+            return on ? "on" : "off";
+        case IO_ANALOG_INPUT:
+            return String(number);
+        case IO_RTC_TEMPERATURE:
+            return String(real);
+    }
+    return "";
+}
+
+String SensorEvent::getName() const
+{
+    return String("sensor") + String(index + 1);
+}
+
+bool EventBus::subscribe(uint32_t topicMask, EventDelegate dlg)
+{
+    if (numSubscribers == EVENT_MAX_SUBSCRIBERS)
+    {
+        Debug.println("ERROR: too many event subscribers");
+        return false;
+    }
+
+    subscribers[numSubscribers] = dlg;
+    topics[numSubscribers] = topicMask;
+    numSubscribers++;
+    return true;
+}
+
+bool EventBus::publish(const Event &event)
+{
+    bool queued = false;
+
+    noInterrupts();
+    if (count < EVENT_QUEUE_SIZE)
+    {
+        queue[(head + count) % EVENT_QUEUE_SIZE] = event;
+        count++;
+        if (count > maxQueued)
+            maxQueued = count;
+        published[event.topic]++;
+        queued = true;
+    }
+    else
+    {
+        dropped++;
+    }
+    interrupts();
+
+    if (queued && !dispatchTimer.isStarted())
+        dispatchTimer.initializeMs(1, TimerDelegate(&EventBus::dispatch, this)).startOnce();
+    return queued;
+}
+
+bool EventBus::publishDigital(bool output, uint8_t index, bool on)
+{
+    Event event;
+
+    event.topic = EVENT_IO;
+    event.io.kind = output ? IO_DIGITAL_OUTPUT : IO_DIGITAL_INPUT;
+    event.io.index = index;
+    event.io.on = on;
+    return publish(event);
+}
+
+bool EventBus::publishAnalog(uint8_t index, int32_t number)
+{
+    Event event;
+
+    event.topic = EVENT_IO;
+    event.io.kind = IO_ANALOG_INPUT;
+    event.io.index = index;
+    event.io.number = number;
+    return publish(event);
+}
+
+bool EventBus::publishTemperature(float real)
+{
+    Event event;
+
+    event.topic = EVENT_IO;
+    event.io.kind = IO_RTC_TEMPERATURE;
+    event.io.index = 0;
+    event.io.real = real;
+    return publish(event);
+}
+
+bool EventBus::publishMessage(const MyMessage &message)
+{
+    Event event;
+
+    event.topic = EVENT_RADIO_RX;
+    memcpy(event.message, &message, sizeof(MyMessage));
+    return publish(event);
+}
+
+bool EventBus::publishSystem(uint8_t kind, uint32_t value)
+{
+    Event event;
+
+    event.topic = EVENT_SYSTEM;
+    event.system.kind = kind;
+    event.system.value = value;
+    return publish(event);
+}
+
+/*
+ * Runs the events queued when the timer was armed, events published by
+ * the subscribers meanwhile wait for the next run.
+ */
+void EventBus::dispatch()
+{
+    int pending = count;
+
+    if (dropped > 0 && !dropLogged)
+    {
+        LOG(GW, LOG_WARN, "Event queue full, %lu events dropped", dropped);
+        dropLogged = true;
+    }
+
+    while (pending-- > 0)
+    {
+        Event event;
+
+        noInterrupts();
+        event = queue[head];
+        head = (head + 1) % EVENT_QUEUE_SIZE;
+        count--;
+        interrupts();
+
+        PERF_SCOPE(PERF_EVENTS);
+        for (int i = 0; i < numSubscribers; i++)
+            if (topics[i] & EVENT_TOPIC_MASK(event.topic))
+                subscribers[i](event);
+    }
+
+    if (count > 0 && !dispatchTimer.isStarted())
+        dispatchTimer.initializeMs(1, TimerDelegate(&EventBus::dispatch, this)).startOnce();
+}
+
+void EventBus::print(CommandOutput* out)
+{
+    out->printf("Subscribers : %d\r\n", numSubscribers);
+    for (int t = 0; t < EVENT_TOPICS; t++)
+        out->printf("%-11s : %lu published\r\n", topicNames[t], published[t]);
+    out->printf("Queued      : %d of %d (max %d)\r\n",
+                count, EVENT_QUEUE_SIZE, maxQueued);
+    out->printf("Dropped     : %lu\r\n", dropped);
+}
+
+void EventBus::reset()
+{
+    memset(published, 0, sizeof(published));
+    dropped = 0;
+    dropLogged = false;
+    maxQueued = count;
+}
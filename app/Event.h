@@ -0,0 +1,161 @@
+#ifndef INCLUDE_EVENT_H_
+#define INCLUDE_EVENT_H_
+
+#include <user_config.h>
+#include <SmingCore/SmingCore.h>
+#include "MySensors/MyMessage.h"
+
+/*
+ * Internal publish/subscribe. A producer fills in a fixed size Event
+ * and publish() copies it into a preallocated ring; nothing is called
+ * from the producer's context. A one-shot timer then hands each event
+ * to the subscribers whose topic mask has its topic, in the order they
+ * subscribed. So the radio RX path and the I2C callbacks only pay for a
+ * copy, the rules, WebSocket pushes and MQTT publishes run afterwards.
+ *
+ * The ring is only touched with interrupts masked. When it is full the
+ * event is dropped and counted, the producer carries on; the first drop
+ * is logged by the next dispatch.
+ *
+ * EVENT_QUEUE_SIZE covers what can arrive within the 1 ms before the
+ * dispatch runs. The radio is polled every 100 us, but at RF24_250KBPS a
+ * full packet is 1.3 ms on air, so one packet and its two events
+ * (EVENT_SENSOR, EVENT_RADIO_RX) per dispatch at most. Expander inputs
+ * are read every 100 ms and normally change one or two at a time, the
+ * analog channels, the RTC and the system events are slower still.
+ * Only all pins of an expander flipping together can overflow it.
+ */
+enum EventTopic
+{
+    EVENT_IO,               // local I/O changed, 'io' is set
+    EVENT_SENSOR,           // a radio sensor was updated, 'sensor' is set
+    EVENT_RADIO_RX,         // a message from the radio, see getMessage()
+    EVENT_SYSTEM,           // gateway state changed, 'system' is set
+    EVENT_TOPICS
+};
+
+#define EVENT_TOPIC_MASK(topic)  (1 << (topic))
+#define EVENT_ALL_TOPICS         ((1 << EVENT_TOPICS) - 1)
+
+#define EVENT_QUEUE_SIZE         16
+#define EVENT_MAX_SUBSCRIBERS    8
+
+/*
+ * Changes of the local I/O (expander pins, the RTC temperature): what
+ * kind of resource, which one and its new value. Producers don't build
+ * any text, a subscriber that needs the object name and value as a
+ * string (the controller, the rules) asks for them.
+ */
+enum IOResourceKind
+{
+    IO_DIGITAL_INPUT,       // inputD<index>, 'on' is set
+    IO_DIGITAL_OUTPUT,      // outputD<index>, 'on' is set
+    IO_ANALOG_INPUT,        // inputA<index>, 'number' is set
+    IO_RTC_TEMPERATURE,     // RTC-temperature, 'real' is set
+};
+
+struct IOEvent
+{
+    uint8_t kind;
+    uint8_t index;
+    union
+    {
+        bool    on;
+        int32_t number;
+        float   real;
+    };
+
+    String getName() const;
+    String getValue() const;
+};
+
+/*
+ * An entry of the gateway's sensor table was added or updated, as it
+ * was at that moment; the table itself may have moved on by dispatch.
+ */
+#define SENSOR_EVENT_VALUE_SIZE  (MAX_PAYLOAD * 2 + 1)
+
+struct SensorEvent
+{
+    uint8_t index;          // in the sensor table, sensor<index + 1>
+    uint8_t node;
+    uint8_t sensor;
+    uint8_t type;
+    bool    set;            // a C_SET brought a value
+    bool    changed;        // and it differs from the previous one
+    char    value[SENSOR_EVENT_VALUE_SIZE];
+
+    String getName() const;
+};
+
+/*
+ * State of the gateway itself. SYSTEM_STATUS and SYSTEM_FIRMWARE only
+ * say that MyStatus has an update for the status page waiting.
+ */
+enum SystemEventKind
+{
+    SYSTEM_FREE_HEAP,       // 'value' is the free heap in bytes
+    SYSTEM_STATUS,          // status values changed
+    SYSTEM_FIRMWARE,        // firmware download started or ended
+};
+
+struct SystemEvent
+{
+    uint8_t  kind;
+    uint32_t value;
+};
+
+struct Event
+{
+    uint8_t topic;
+    union
+    {
+        IOEvent     io;
+        SensorEvent sensor;
+        SystemEvent system;
+        uint8_t     message[sizeof(MyMessage)];
+    };
+
+    const MyMessage &getMessage() const { return *(const MyMessage *)message; }
+};
+
+typedef Delegate<void(const Event &)> EventDelegate;
+
+class EventBus
+{
+  public:
+    bool subscribe(uint32_t topics, EventDelegate dlg);
+    bool publish(const Event &event);
+
+    bool publishDigital(bool output, uint8_t index, bool on);
+    bool publishAnalog(uint8_t index, int32_t number);
+    bool publishTemperature(float real);
+    bool publishMessage(const MyMessage &message);
+    bool publishSystem(uint8_t kind, uint32_t value = 0);
+
+    void print(CommandOutput* out);
+    void reset();
+
+  private:
+    void dispatch();
+
+  private:
+    Event           queue[EVENT_QUEUE_SIZE];
+    uint8_t         head = 0;       // next event to dispatch
+    uint8_t         count = 0;
+
+    EventDelegate   subscribers[EVENT_MAX_SUBSCRIBERS];
+    uint32_t        topics[EVENT_MAX_SUBSCRIBERS];
+    uint8_t         numSubscribers = 0;
+
+    Timer           dispatchTimer;
+
+    uint32_t        published[EVENT_TOPICS];
+    uint32_t        dropped = 0;
+    bool            dropLogged = false;
+    uint8_t         maxQueued = 0;
+};
+
+extern EventBus Events;
+
+#endif //INCLUDE_EVENT_H_
@@ -3,6 +3,9 @@
 #include <HTTP.h>
 #include <Network.h>
 #include <SDCard.h>
+#include <StaticFiles.h>
+#include <History.h>
+#include <Perf.h>
 #include <MyGateway.h>
 #include <MyStatus.h>
 #include <AppSettings.h>
@@ -88,7 +91,7 @@ void onIpConfig(HttpRequest &request, HttpResponse &response)
 
 void onStatus(HttpRequest &request, HttpResponse &response)
 {
-    response.sendFile("status.html");
+    StaticFiles.send(request, response, "status.html");
 }
 
 void onMaintenance(HttpRequest &request, HttpResponse &response)
@@ -132,61 +135,53 @@ void onMaintenance(HttpRequest &request, HttpResponse &response)
 
 void onFile(HttpRequest &request, HttpResponse &response)
 {
-#ifdef SD_SPI_SS_PIN
-    static bool alreadyInitialized = false;
-#endif
-
     if (!HTTP.isHttpClientAllowed(request, response))
         return;
 
-    String file = request.getPath();
-    if (file[0] == '/')
-        file = file.substring(1);
+    Debug.printf("REQUEST for %s\n", request.getPath().c_str());
+    StaticFiles.send(request, response, request.getPath());
+}
 
-    if (file[0] == '.')
-        response.forbidden();
+#define SESSION_COOKIE_NAME "gwsession"
+
+void HTTPClass::updateCredentials()
+{
+    String userpass = "admin:" + AppSettings.apPassword;
+    int encodedSize = 4 * ((userpass.length() + 2) / 3) + 1;
+    char *encoded = new char[encodedSize];
+    char token[17];
+
+    int r = base64_encode(userpass.length(),
+                          (const unsigned char *)userpass.c_str(),
+                          encodedSize, encoded);
+
+    credentialsPassword = AppSettings.apPassword;
+    if (r > 0)
+    {
+        encoded[r] = 0;
+        expectedAuthHeader = String("Basic ") + encoded;
+    }
     else
     {
-        response.setCache(86400, true); // It's important to use cache for better performance.
-
-        // open the file. note that only one file can be open at a time,
-        // so you have to close this one before opening another.
-        Debug.printf("REQUEST for %s\n", file.c_str());
-#ifdef SD_SPI_SS_PIN
-        if (alreadyInitialized || SD.begin(0))
-        {
-            alreadyInitialized = true;
-            Debug.printf("SD card present\n");
-            File f = SD.open(file);
-            if (!f) //SD.exists(file) does not seem to work
-            {
-                Debug.printf("NOT FOUND %s\n", file.c_str());
-                response.sendFile(file);
-            }
-            else if (f.isDirectory())
-            {
-                f.close();
-                Debug.printf("%s IS A DIRECTORY\n", file.c_str());
-                response.forbidden();
-            }
-            else
-            {
-                f.close();
-                Debug.printf("OPEN STREAM FOR %s\n", file.c_str());
-                response.setAllowCrossDomainOrigin("*");
-                const char *mime = ContentType::fromFullFileName(file);
-		if (mime != NULL)
-		    response.setContentType(mime);
-                SdFileStream *stream = new SdFileStream(file);
-                response.sendDataStream(stream);
-            }
-        }
-        else
-#endif
-        {
-            response.sendFile(file);
-        }
+        /* Left empty, isHttpClientAllowed then rejects every request */
+        Debug.println("ERROR: cannot encode the HTTP credentials");
+        expectedAuthHeader = "";
     }
+    delete[] encoded;
+
+    /* A new password invalidates all sessions handed out before */
+    sprintf(token, "%08x%08x", os_random(), os_random());
+    sessionCookie = String(SESSION_COOKIE_NAME "=") + token;
+}
+
+bool HTTPClass::secureEquals(const String &a, const String &b)
+{
+    /* Always walk the full expected value so the time taken does not
+     * reveal how much of the credential matched. */
+    uint8_t diff = a.length() != b.length();
+    for (int i = 0; i < b.length(); i++)
+        diff |= (uint8_t)(i < a.length() ? a[i] : 0) ^ (uint8_t)b[i];
+    return diff == 0;
 }
 
 bool HTTPClass::isHttpClientAllowed(HttpRequest &request, HttpResponse &response)
@@ -194,27 +189,36 @@ bool HTTPClass::isHttpClientAllowed(HttpRequest &request, HttpResponse &response
     if (AppSettings.apPassword.equals(""))
         return true;
 
-    String authHeader = request.getHeader("Authorization");
-    char userpass[32+1+32+1];
-    if (!authHeader.equals("") && authHeader.startsWith("Basic"))
+    if (!credentialsPassword.equals(AppSettings.apPassword))
+        updateCredentials();
+
+    if (expectedAuthHeader.length() == 0)
     {
-        Debug.printf("Authorization header %s\n", authHeader.c_str());
-        int r = base64_decode(authHeader.length()-6,
-                              authHeader.substring(6).c_str(),
-                              sizeof(userpass),
-                              (unsigned char *)userpass);
-        if (r > 0)
+        /* Fail closed, an empty credential must never match */
+        response.forbidden();
+        return false;
+    }
+
+    String cookies = request.getHeader("Cookie");
+    if (cookies.length() > 0)
+    {
+        int start = cookies.indexOf(SESSION_COOKIE_NAME "=");
+        if (start >= 0)
         {
-            userpass[r]=0; //zero-terminate user:pass string
-            Debug.printf("Authorization header decoded %s\n", userpass);
-            String validUserPass = "admin:"+AppSettings.apPassword;
-            if (validUserPass.equals(userpass))
-            {
+            int end = cookies.indexOf(';', start);
+            if (end < 0)
+                end = cookies.length();
+            if (secureEquals(cookies.substring(start, end), sessionCookie))
                 return true;
-            }
         }
     }
 
+    if (secureEquals(request.getHeader("Authorization"), expectedAuthHeader))
+    {
+        response.setHeader("Set-Cookie", sessionCookie + "; Path=/; HttpOnly");
+        return true;
+    }
+
     response.authorizationRequired();
     response.setHeader("Content-Type", "text/plain");
     response.setHeader("WWW-Authenticate",
@@ -264,15 +268,49 @@ void HTTPClass::addWsCommand(String command, WebSocketMessageDelegate callback)
 
 void HTTPClass::notifyWsClients(String message)
 {
+    PERF_SCOPE(PERF_WS_NOTIFY);
     WebSocketsList &clients = server.getActiveWebSockets();
     for (int i = 0; i < clients.count(); i++)
         clients[i].sendString(message);
 }
 
+/*
+ * Pushes added and updated sensors and the status page updates to the
+ * WebSocket clients. A value set again unchanged is not sent.
+ */
+void HTTPClass::onEvent(const Event &event)
+{
+    if (event.topic == EVENT_SYSTEM)
+    {
+        String update;
+        if (event.system.kind == SYSTEM_STATUS)
+            update = getStatusObj().takeStatusUpdate();
+        else if (event.system.kind == SYSTEM_FIRMWARE)
+            update = getStatusObj().takeFirmwareUpdate();
+
+        if (update.length() > 0)
+            notifyWsClients(update);
+        return;
+    }
+
+    if (server.getActiveWebSockets().count() == 0)
+        return;
+
+    if (event.sensor.set && !event.sensor.changed)
+        return;
+
+    notifyWsClients(MyGateway::getSensorJson(event.sensor));
+}
+
 void HTTPClass::begin()
 {
+    StaticFiles.begin();
+
     server.listen(80);
     server.enableHeaderProcessing("Authorization");
+    server.enableHeaderProcessing("Cookie");
+    server.enableHeaderProcessing("Accept-Encoding");
+    server.enableHeaderProcessing("If-None-Match");
     server.addPath("/", onStatus);
     server.addPath("/ipconfig", onIpConfig);
     server.addPath("/status", onStatus);
@@ -280,6 +318,12 @@ void HTTPClass::begin()
 
     GW.registerHttpHandlers(server);
     controller.registerHttpHandlers(server);
+#ifdef SD_SPI_SS_PIN
+    History.registerHttpHandlers(server);
+#endif
+#if PERF_ENABLE
+    Perf.registerHttpHandlers(server);
+#endif
     server.setDefaultHandler(onFile);
     getStatusObj().registerHttpHandlers(server);
 
@@ -293,6 +337,10 @@ void HTTPClass::begin()
         WebSocketBinaryDelegate(&HTTPClass::wsBinaryReceived, this));
     server.setWebSocketDisconnectionHandler(
         WebSocketDelegate(&HTTPClass::wsDisconnected, this));
+
+    Events.subscribe(EVENT_TOPIC_MASK(EVENT_SENSOR) |
+                     EVENT_TOPIC_MASK(EVENT_SYSTEM),
+                     EventDelegate(&HTTPClass::onEvent, this));
 }
 
 HTTPClass HTTP;
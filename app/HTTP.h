@@ -5,6 +5,7 @@
 #include <SmingCore/SmingCore.h>
 #include <SmingCore/Debug.h>
 #include <AppSettings.h>
+#include <Event.h>
 
 class HTTPClass
 {
@@ -17,15 +18,25 @@ class HTTPClass
     void notifyWsClients(String message);
 
   private:
+    void updateCredentials();
+    static bool secureEquals(const String &a, const String &b);
+
     /* Websocket handlers */
     void wsConnected(WebSocket& socket);
     void wsMessageReceived(WebSocket& socket, const String& message);
     void wsBinaryReceived(WebSocket& socket, uint8_t* data, size_t size);
     void wsDisconnected(WebSocket& socket);
+    void onEvent(const Event &event);
 
   private:
     HttpServer server;
     HashMap<String, WebSocketMessageDelegate> wsCommandHandlers;
+
+    /* Expected Authorization header and session cookie, recomputed
+     * only when AppSettings.apPassword changes. */
+    String credentialsPassword;
+    String expectedAuthHeader;
+    String sessionCookie;
 };
 
 extern HTTPClass HTTP;
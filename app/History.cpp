@@ -0,0 +1,537 @@
+#include <user_config.h>
+#include <SmingCore/SmingCore.h>
+#include <SmingCore/Debug.h>
+#include <History.h>
+#include <SDCard.h>
+#include <HistoryQuery.h>
+#include <HTTP.h>
+
+HistoryClass History;
+
+String HistoryClass::getFileName(uint32_t day, const char *ext)
+{
+    char name[24];
+    DateTime dt(day * 86400);
+
+    sprintf(name, HISTORY_DIR "/%04d%02d%02d.%s",
+            dt.Year, dt.Month + 1, dt.Day, ext);
+    return name;
+}
+
+bool HistoryClass::isValidBlock(const HistoryBlockHeader &header, uint32_t day)
+{
+    return header.magic == HISTORY_BLOCK_MAGIC &&
+           header.day == day &&
+           header.count > 0 &&
+           header.count <= HISTORY_RECORDS_PER_BLOCK;
+}
+
+/*
+ * Index of the block of 'day' the records at or after 'time' start in,
+ * found by binary search of the day's index. Blocks missing from the
+ * index come after it, so the caller just scans on.
+ */
+uint32_t HistoryClass::findBlock(uint32_t day, uint32_t time)
+{
+    File idx = SD.open(getFileName(day, "IDX"));
+    if (!idx)
+        return 0;
+
+    uint32_t first;
+    uint32_t lo = 0, hi = idx.size() / sizeof(first);
+    while (lo < hi)
+    {
+        uint32_t mid = (lo + hi) / 2;
+        if (!idx.seek(mid * sizeof(first)) ||
+            idx.read(&first, sizeof(first)) != (int)sizeof(first))
+            break;
+        if (first < time)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    idx.close();
+
+    return lo ? lo - 1 : 0;
+}
+
+void HistoryClass::startBlock()
+{
+    memset(&block, 0, sizeof(block));
+    block.header.magic = HISTORY_BLOCK_MAGIC;
+    block.header.day = currentDay;
+    dirty = false;
+}
+
+/*
+ * Make the file for 'day' current. A new file is created contiguous and
+ * at full size, so appending never has to update the FAT. An existing
+ * file (after a reboot) is resumed after its last full block.
+ */
+bool HistoryClass::openDay(uint32_t day)
+{
+    String fileName = getFileName(day);
+
+    if (!sdCardMount())
+        return false;
+
+    if (!SD.exists(HISTORY_DIR) && !SD.mkdir(HISTORY_DIR))
+    {
+        Debug.printf("History: can't create %s\n", HISTORY_DIR);
+        return false;
+    }
+
+    currentDay = day;
+    blockIndex = 0;
+    indexedBlocks = 0;
+    startBlock();
+
+    if (!SD.exists(fileName))
+    {
+        /* An index without its log would point at the wrong blocks */
+        SD.remove(getFileName(day, "IDX"));
+
+        File f = SD.createContiguous(fileName, HISTORY_FILE_SIZE);
+        if (!f)
+        {
+            Debug.printf("History: can't create %s\n", fileName.c_str());
+            currentDay = 0;
+            return false;
+        }
+        f.close();
+        Debug.printf("History: created %s\n", fileName.c_str());
+        return true;
+    }
+
+    File f = SD.open(fileName);
+    if (!f)
+    {
+        currentDay = 0;
+        return false;
+    }
+
+    /* Full blocks form a prefix of the file, binary search its end */
+    HistoryBlockHeader header;
+    uint32_t lo = 0, hi = f.size() / sizeof(HistoryBlock);
+    while (lo < hi)
+    {
+        uint32_t mid = (lo + hi) / 2;
+        if (!f.seek(mid * sizeof(HistoryBlock)) ||
+            f.read(&header, sizeof(header)) != (int)sizeof(header))
+            break;
+        if (isValidBlock(header, day) &&
+            header.count == HISTORY_RECORDS_PER_BLOCK)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    blockIndex = lo;
+
+    /* Pick up the records of a partially written block */
+    if (f.seek(blockIndex * sizeof(HistoryBlock)) &&
+        f.read(&block, sizeof(block)) == (int)sizeof(block) &&
+        isValidBlock(block.header, day))
+        dirty = false;
+    else
+        startBlock();
+    f.close();
+
+    Debug.printf("History: resuming %s at block %d (%d records)\n",
+                 fileName.c_str(), blockIndex, block.header.count);
+
+    /* Whatever was lost to a reset is recovered from the log itself */
+    if (updateIndex(blockIndex + (block.header.count ? 1 : 0)))
+        indexedBlocks = blockIndex + (block.header.count ? 1 : 0);
+    rebuildRollups();
+    return true;
+}
+
+bool HistoryClass::writeBlock()
+{
+    String fileName = getFileName(currentDay);
+
+    /* A whole aligned block goes to the card without read-modify-write */
+    File f = SD.open(fileName, O_RDWR);
+    if (!f)
+        return false;
+
+    bool ok = f.seek(blockIndex * sizeof(HistoryBlock)) &&
+              f.write((const uint8_t *)&block, sizeof(block)) == sizeof(block);
+    f.close();
+
+    if (ok)
+    {
+        blocksWritten++;
+        dirty = false;
+        if (blockIndex >= indexedBlocks && updateIndex(blockIndex + 1))
+            indexedBlocks = blockIndex + 1;
+    }
+    else
+    {
+        Debug.printf("History: write of %s block %d failed\n",
+                     fileName.c_str(), blockIndex);
+    }
+    return ok;
+}
+
+/* Write out the full block if that's still pending and start the next */
+bool HistoryClass::nextBlock()
+{
+    if (dirty && !writeBlock())
+        return false;
+
+    blockIndex++;
+    startBlock();
+    if (blockIndex == HISTORY_FILE_BLOCKS)
+        Debug.printf("History: %s is full\n",
+                     getFileName(currentDay).c_str());
+    return true;
+}
+
+/*
+ * Append the time of the first record of every block below 'blocks' that
+ * the index doesn't have yet. Normally that is just the block at hand,
+ * after a reset the missing entries are read back from the log.
+ */
+bool HistoryClass::updateIndex(uint32_t blocks)
+{
+    File idx = SD.open(getFileName(currentDay, "IDX"), FILE_WRITE);
+    if (!idx)
+        return false;
+
+    File f;
+    uint32_t time;
+    uint32_t indexed = idx.size() / sizeof(time);
+    bool ok = idx.seek(indexed * sizeof(time)); // drop a torn entry
+
+    for (uint32_t i = indexed; ok && i < blocks; i++)
+    {
+        if (i == blockIndex)
+        {
+            time = block.records[0].time;
+        }
+        else
+        {
+            HistoryBlockHeader header;
+
+            if (!f)
+                f = SD.open(getFileName(currentDay));
+            ok = f && f.seek(i * sizeof(HistoryBlock)) &&
+                 f.read(&header, sizeof(header)) == (int)sizeof(header) &&
+                 isValidBlock(header, currentDay) &&
+                 f.read(&time, sizeof(time)) == (int)sizeof(time);
+            if (!ok)
+                break;
+        }
+        ok = idx.write((const uint8_t *)&time, sizeof(time)) == sizeof(time);
+    }
+
+    if (f)
+        f.close();
+    idx.close();
+    return ok;
+}
+
+void HistoryClass::writeRollups()
+{
+    if (numRollups == 0)
+        return;
+
+    String fileName = getFileName(rollupHour / 86400, "HR");
+    File f = SD.open(fileName, FILE_WRITE);
+    size_t len = numRollups * sizeof(HistoryRollup);
+
+    if (f && f.write((const uint8_t *)rollups, len) == len)
+        rollupsWritten += numRollups;
+    else
+        Debug.printf("History: write of %s failed\n", fileName.c_str());
+    if (f)
+        f.close();
+
+    numRollups = 0;
+}
+
+/* Fold a record into the hourly rollups, writing out the previous hour */
+void HistoryClass::rollupRecord(const HistoryRecord &rec)
+{
+    uint32_t hour = rec.time - rec.time % HISTORY_ROLLUP_PERIOD;
+
+    /* The clock went back, the rollup file must stay sorted */
+    if (hour < rollupHour)
+        return;
+
+    if (hour != rollupHour)
+    {
+        writeRollups();
+        rollupHour = hour;
+    }
+
+    HistoryRollup *r = NULL;
+    for (int i = 0; i < numRollups && !r; i++)
+        if (rollups[i].node == rec.node && rollups[i].sensor == rec.sensor &&
+            rollups[i].type == rec.type)
+            r = &rollups[i];
+
+    if (!r)
+    {
+        if (numRollups == HISTORY_MAX_ROLLUPS)
+            return;
+        r = &rollups[numRollups++];
+        memset(r, 0, sizeof(*r));
+        r->time = hour;
+        r->node = rec.node;
+        r->sensor = rec.sensor;
+        r->type = rec.type;
+        r->min = r->max = rec.value;
+    }
+
+    r->count++;
+    r->sum += rec.value;
+    if (rec.value < r->min)
+        r->min = rec.value;
+    if (rec.value > r->max)
+        r->max = rec.value;
+}
+
+/*
+ * After a reset the rollups of the running hour only exist in the log,
+ * as do those of any hour that ended while we were down. Replay the log
+ * from where the rollup file ends to catch up.
+ */
+void HistoryClass::rebuildRollups()
+{
+    uint32_t from = currentDay * 86400;
+    HistoryRollup last;
+
+    writeRollups();
+    rollupHour = 0;
+
+    File hr = SD.open(getFileName(currentDay, "HR"));
+    if (hr)
+    {
+        uint32_t n = hr.size() / sizeof(last);
+        if (n > 0 && hr.seek((n - 1) * sizeof(last)) &&
+            hr.read(&last, sizeof(last)) == (int)sizeof(last))
+            from = last.time + HISTORY_ROLLUP_PERIOD;
+        hr.close();
+    }
+
+    HistoryBlock *blk = new HistoryBlock;
+    File f = SD.open(getFileName(currentDay));
+    for (uint32_t i = findBlock(currentDay, from); f && i < blockIndex; i++)
+    {
+        if (!f.seek(i * sizeof(HistoryBlock)) ||
+            f.read(blk, sizeof(HistoryBlock)) != (int)sizeof(HistoryBlock) ||
+            !isValidBlock(blk->header, currentDay))
+            break;
+        for (int j = 0; j < blk->header.count; j++)
+            if (blk->records[j].time >= from)
+                rollupRecord(blk->records[j]);
+        WDT.alive();
+    }
+    if (f)
+        f.close();
+    delete blk;
+
+    for (int j = 0; j < block.header.count; j++)
+        if (block.records[j].time >= from)
+            rollupRecord(block.records[j]);
+}
+
+/* The running hour of a sensor, all its value types merged */
+bool HistoryClass::getPendingRollup(uint8_t node, uint8_t sensor,
+                                    HistoryRollup &rollup)
+{
+    bool found = false;
+
+    for (int i = 0; i < numRollups; i++)
+    {
+        HistoryRollup &r = rollups[i];
+        if (r.node != node || r.sensor != sensor)
+            continue;
+        if (!found)
+        {
+            rollup = r;
+            found = true;
+            continue;
+        }
+        rollup.count += r.count;
+        rollup.sum += r.sum;
+        if (r.min < rollup.min)
+            rollup.min = r.min;
+        if (r.max > rollup.max)
+            rollup.max = r.max;
+    }
+    return found;
+}
+
+void HistoryClass::flush()
+{
+    flushTimer.stop();
+    if (dirty)
+        writeBlock();
+}
+
+void HistoryClass::log(uint32_t time, uint8_t node, uint8_t sensor,
+                       uint8_t type, float value)
+{
+    uint32_t day = time / 86400;
+
+    if (day != currentDay)
+    {
+        flush();
+
+        /* Without a card, don't stall every message on a mount attempt */
+        if ((int32_t)(millis() - retryTime) < 0)
+        {
+            recordsDropped++;
+            return;
+        }
+        if (!openDay(day))
+        {
+            retryTime = millis() + HISTORY_RETRY_DELAY;
+            recordsDropped++;
+            return;
+        }
+    }
+
+    /* A full block whose write failed is retried before adding to it */
+    if (block.header.count == HISTORY_RECORDS_PER_BLOCK && !nextBlock())
+    {
+        recordsDropped++;
+        return;
+    }
+
+    /* Past the preallocated size the file would grow through the FAT */
+    if (blockIndex >= HISTORY_FILE_BLOCKS)
+    {
+        recordsDropped++;
+        return;
+    }
+
+    HistoryRecord *rec = &block.records[block.header.count++];
+    rec->time = time;
+    rec->node = node;
+    rec->sensor = sensor;
+    rec->type = type;
+    rec->value = value;
+    recordsLogged++;
+    dirty = true;
+    rollupRecord(*rec);
+
+    if (block.header.count == HISTORY_RECORDS_PER_BLOCK)
+    {
+        /* On failure the records stay, the next one retries the write */
+        flushTimer.stop();
+        nextBlock();
+    }
+    else if (!flushTimer.isStarted())
+    {
+        /* Don't sit on a partial block forever */
+        flushTimer.initializeMs(HISTORY_FLUSH_DELAY,
+                                TimerDelegate(&HistoryClass::flush, this));
+        flushTimer.startOnce();
+    }
+}
+
+void HistoryClass::log(const MyMessage &message)
+{
+    const char *text;
+    char *end;
+    float value;
+
+    switch (mGetPayloadType(message))
+    {
+        case P_BYTE:    value = message.bValue; break;
+        case P_INT16:   value = (int16_t)message.iValue; break;
+        case P_UINT16:  value = (uint16_t)message.uiValue; break;
+        case P_LONG32:  value = message.lValue; break;
+        case P_ULONG32: value = message.ulValue; break;
+        case P_FLOAT32: value = message.fValue; break;
+        case P_STRING:
+            text = GW.getPayloadString(message);
+            value = strtod(text, &end);
+            if (end == text)
+                return; // not a number, nothing to chart
+            break;
+        default:
+            return;
+    }
+
+    uint32_t now = SystemClock.now(eTZ_UTC).toUnixTime();
+    if (now < HISTORY_MIN_TIME)
+    {
+        recordsDropped++;
+        return;
+    }
+
+    log(now, message.sender, message.sensor, message.type, value);
+}
+
+void HistoryClass::printStatus(CommandOutput* out)
+{
+    out->printf("File               : %s\r\n", currentDay ?
+                getFileName(currentDay).c_str() : "(none)");
+    out->printf("Block              : %d (%d records pending)\r\n",
+                blockIndex, block.header.count);
+    out->printf("Records logged     : %lu (%lu dropped)\r\n",
+                recordsLogged, recordsDropped);
+    out->printf("Blocks written     : %lu\r\n", blocksWritten);
+    out->printf("Rollups written    : %lu (%d pending)\r\n",
+                rollupsWritten, numRollups);
+}
+
+/*
+ * GET /history?sensor=<node>/<sensor>&from=<time>&to=<time>&step=<secs>
+ * Min/max/avg of a sensor per 'step' seconds, streamed as JSON. Times are
+ * unix times, 'to' defaults to now and 'from' to a day before. Steps of
+ * whole hours are answered from the rollups, finer ones from the logs.
+ */
+void HistoryClass::onHttpHistory(HttpRequest &request, HttpResponse &response)
+{
+    if (!HTTP.isHttpClientAllowed(request, response))
+        return;
+
+    String sensor = request.getQueryParameter("sensor");
+    uint32_t to = request.getQueryParameter("to").toInt();
+    uint32_t from = request.getQueryParameter("from").toInt();
+    uint32_t step = request.getQueryParameter("step").toInt();
+    int slash = sensor.indexOf('/');
+
+    if (to == 0)
+        to = SystemClock.now(eTZ_UTC).toUnixTime();
+    if (from == 0)
+        from = to - 86400;
+    if (step == 0)
+        step = (to - from + HISTORY_QUERY_MAX_BUCKETS - 1) /
+               HISTORY_QUERY_MAX_BUCKETS;
+
+    if (slash <= 0 || from >= to || step == 0 ||
+        (to - from) / step > HISTORY_QUERY_MAX_BUCKETS)
+    {
+        response.badRequest();
+        return;
+    }
+
+    if (!sdCardMount())
+    {
+        response.notFound();
+        return;
+    }
+
+    /* Let the query see the records still sitting in RAM */
+    flush();
+
+    response.setContentType(ContentType::JSON);
+    response.setAllowCrossDomainOrigin("*");
+    response.sendDataStream(new HistoryQueryStream(
+        sensor.substring(0, slash).toInt(),
+        sensor.substring(slash + 1).toInt(),
+        from, to, step));
+}
+
+void HistoryClass::registerHttpHandlers(HttpServer &server)
+{
+    server.addPath("/history",
+                   HttpPathDelegate(&HistoryClass::onHttpHistory, this));
+}
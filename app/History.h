@@ -0,0 +1,121 @@
+#ifndef INCLUDE_HISTORY_H_
+#define INCLUDE_HISTORY_H_
+
+#include <user_config.h>
+#include <SmingCore/SmingCore.h>
+#include <SmingCore/Debug.h>
+#include <MyGateway.h>
+
+/*
+ * Sensor history is kept on the SD card as one binary file per day,
+ * HISTORY/YYYYMMDD.LOG. Each file is a sequence of 512 byte blocks, a
+ * small header followed by fixed size records. Blocks fill up in order,
+ * so the records of a block are sorted by time and so are the blocks.
+ *
+ * Next to each log two small files are kept up to date so queries don't
+ * have to scan it: YYYYMMDD.IDX holds the time of the first record of
+ * every block, and YYYYMMDD.HR holds per-hour min/max/sum rollups of
+ * every sensor, appended when the hour is over.
+ */
+#define HISTORY_DIR              "HISTORY"
+#define HISTORY_FILE_SIZE        (256UL * 1024) // preallocated per day
+#define HISTORY_FLUSH_DELAY      60000          // ms a partial block may wait
+#define HISTORY_RETRY_DELAY      60000          // ms between tries to open
+#define HISTORY_BLOCK_MAGIC      0x4c48         // "HL"
+#define HISTORY_MIN_TIME         1451606400     // 2016-01-01, clock not set
+#define HISTORY_ROLLUP_PERIOD    3600           // seconds per rollup record
+#define HISTORY_MAX_ROLLUPS      MAX_MY_SENSORS // sensors tracked per hour
+#define HISTORY_QUERY_MAX_BUCKETS 1000          // per /history request
+
+typedef struct
+{
+    uint32_t time;      // unix time, UTC
+    uint8_t  node;
+    uint8_t  sensor;
+    uint8_t  type;      // V_* value type
+    uint8_t  reserved;
+    float    value;
+} __attribute__((packed)) HistoryRecord;
+
+typedef struct
+{
+    uint16_t magic;     // HISTORY_BLOCK_MAGIC
+    uint16_t count;     // valid records in this block
+    uint32_t day;       // days since the epoch, tells stale blocks apart
+} __attribute__((packed)) HistoryBlockHeader;
+
+#define HISTORY_RECORDS_PER_BLOCK \
+    ((512 - sizeof(HistoryBlockHeader)) / sizeof(HistoryRecord))
+
+typedef struct
+{
+    HistoryBlockHeader header;
+    HistoryRecord      records[HISTORY_RECORDS_PER_BLOCK];
+} __attribute__((packed)) HistoryBlock;
+
+/* Blocks that fit the preallocated file, a day stops logging after that */
+#define HISTORY_FILE_BLOCKS (HISTORY_FILE_SIZE / sizeof(HistoryBlock))
+
+typedef struct
+{
+    uint32_t time;      // start of the hour
+    uint8_t  node;
+    uint8_t  sensor;
+    uint8_t  type;
+    uint8_t  reserved;
+    uint32_t count;
+    float    min;
+    float    max;
+    float    sum;
+} __attribute__((packed)) HistoryRollup;
+
+class HistoryClass
+{
+  public:
+    void log(const MyMessage &message);
+    void log(uint32_t time, uint8_t node, uint8_t sensor, uint8_t type,
+             float value);
+    void flush();
+    void printStatus(CommandOutput* out);
+    void registerHttpHandlers(HttpServer &server);
+
+    bool getPendingRollup(uint8_t node, uint8_t sensor,
+                          HistoryRollup &rollup);
+
+    static String getFileName(uint32_t day, const char *ext = "LOG");
+    static bool isValidBlock(const HistoryBlockHeader &header, uint32_t day);
+    static uint32_t findBlock(uint32_t day, uint32_t time);
+
+  private:
+    bool openDay(uint32_t day);
+    bool writeBlock();
+    bool nextBlock();
+    void startBlock();
+    bool updateIndex(uint32_t blocks);
+    void writeRollups();
+    void rollupRecord(const HistoryRecord &rec);
+    void rebuildRollups();
+    void onHttpHistory(HttpRequest &request, HttpResponse &response);
+
+  private:
+    HistoryBlock block;
+    uint32_t     currentDay = 0;
+    uint32_t     blockIndex = 0;   // position of block in the day's file
+    bool         dirty = false;
+    uint32_t     indexedBlocks = 0; // blocks known to be in the index
+    Timer        flushTimer;
+    uint32_t     retryTime = 0;    // millis() before which opening is skipped
+
+    HistoryRollup rollups[HISTORY_MAX_ROLLUPS];
+    uint8_t      numRollups = 0;
+    uint32_t     rollupHour = 0;   // hour the rollups above belong to
+
+    uint32_t     recordsLogged = 0;
+    uint32_t     recordsDropped = 0;
+    uint32_t     blocksWritten = 0;
+    uint32_t     rollupsWritten = 0;
+};
+
+extern HistoryClass History;
+
+#endif //INCLUDE_HISTORY_H_
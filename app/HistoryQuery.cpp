@@ -0,0 +1,239 @@
+#include <user_config.h>
+#include <SmingCore/SmingCore.h>
+#include <SmingCore/Debug.h>
+#include <HistoryQuery.h>
+
+static String formatValue(float value)
+{
+    char buf[24];
+
+    if (isnan(value) || isinf(value))
+        return "null";
+    return dtostrf(value, 1, 2, buf);
+}
+
+HistoryQueryStream::HistoryQueryStream(uint8_t node, uint8_t sensor,
+                                       uint32_t from, uint32_t to,
+                                       uint32_t step)
+    : node(node), sensor(sensor), to(to), step(step)
+{
+    /* Align the buckets, whole hour steps then line up with the rollups */
+    this->from = from - from % step;
+    useRollups = step % HISTORY_ROLLUP_PERIOD == 0;
+    if (!useRollups)
+        block = new HistoryBlock;
+
+    day = this->from / 86400;
+    acc.count = 0;
+
+    out = "{\"sensor\":\"" + String(node) + "/" + String(sensor) + "\"";
+    out += ",\"from\":" + String(this->from);
+    out += ",\"to\":" + String(to);
+    out += ",\"step\":" + String(step);
+    out += ",\"buckets\":[";
+}
+
+HistoryQueryStream::~HistoryQueryStream()
+{
+    if (file)
+        file.close();
+    delete block;
+}
+
+uint16_t HistoryQueryStream::readMemoryBlock(char* data, int bufSize)
+{
+    fill(bufSize);
+
+    int len = min(bufSize, (int)out.length());
+    memcpy(data, out.c_str(), len);
+    return len;
+}
+
+bool HistoryQueryStream::seek(int len)
+{
+    if (len < 0 || len > (int)out.length())
+        return false;
+
+    out = out.substring(len);
+    return true;
+}
+
+bool HistoryQueryStream::isFinished()
+{
+    return done && out.length() == 0;
+}
+
+void HistoryQueryStream::fill(int size)
+{
+    HistoryRollup value;
+
+    while (!done && (int)out.length() < size)
+    {
+        if (nextValue(value))
+        {
+            addValue(value);
+        }
+        else
+        {
+            emitBucket();
+            out += "]}";
+            done = true;
+        }
+    }
+}
+
+/* Open the file of 'day' and position it at the first candidate record */
+bool HistoryQueryStream::openDay()
+{
+    bool firstDay = day == from / 86400;
+
+    if (useRollups)
+    {
+        file = SD.open(HistoryClass::getFileName(day, "HR"));
+        if (!file)
+            return false;
+        if (!firstDay)
+            return true;
+
+        /* Rollups are appended hour by hour, binary search the start */
+        HistoryRollup r;
+        uint32_t lo = 0, hi = file.size() / sizeof(r);
+        while (lo < hi)
+        {
+            uint32_t mid = (lo + hi) / 2;
+            if (!file.seek(mid * sizeof(r)) ||
+                file.read(&r, sizeof(r)) != (int)sizeof(r))
+                break;
+            if (r.time < from)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        return file.seek(lo * sizeof(r));
+    }
+
+    uint32_t start = firstDay ? HistoryClass::findBlock(day, from) : 0;
+    file = SD.open(HistoryClass::getFileName(day));
+    if (!file)
+        return false;
+
+    block->header.count = 0;
+    recordIndex = 0;
+    return file.seek(start * sizeof(HistoryBlock));
+}
+
+/*
+ * Next value of the sensor, or anything at or past 'to' which ends the
+ * query. Raw records come as a rollup of one.
+ */
+bool HistoryQueryStream::nextValue(HistoryRollup &value)
+{
+    uint32_t lastDay = (to - 1) / 86400;
+
+    while (day <= lastDay)
+    {
+        if (file || openDay())
+        {
+            if (useRollups ? nextRollup(value) : nextRecord(value))
+            {
+                if (value.time < to)
+                    return true;
+                day = lastDay; // files are sorted, the rest is later still
+            }
+        }
+
+        if (file)
+            file.close();
+        day++;
+    }
+
+    /* The running hour is only in RAM until it is over */
+    if (useRollups && !pendingDone)
+    {
+        pendingDone = true;
+        if (History.getPendingRollup(node, sensor, value) &&
+            value.time >= from && value.time < to)
+            return true;
+    }
+    return false;
+}
+
+bool HistoryQueryStream::nextRecord(HistoryRollup &value)
+{
+    while (true)
+    {
+        if (recordIndex >= block->header.count)
+        {
+            /* Blocks of other days are leftovers of an older file */
+            if (file.read(block, sizeof(HistoryBlock)) !=
+                    (int)sizeof(HistoryBlock) ||
+                !HistoryClass::isValidBlock(block->header, day))
+                return false;
+            recordIndex = 0;
+            WDT.alive();
+        }
+
+        const HistoryRecord &rec = block->records[recordIndex++];
+        if (rec.time >= to ||
+            (rec.time >= from && rec.node == node && rec.sensor == sensor))
+        {
+            value.time = rec.time;
+            value.count = 1;
+            value.min = value.max = value.sum = rec.value;
+            return true;
+        }
+    }
+}
+
+bool HistoryQueryStream::nextRollup(HistoryRollup &value)
+{
+    while (file.read(&value, sizeof(value)) == (int)sizeof(value))
+    {
+        if (value.time >= to ||
+            (value.time >= from && value.node == node &&
+             value.sensor == sensor))
+            return true;
+    }
+    return false;
+}
+
+void HistoryQueryStream::addValue(const HistoryRollup &value)
+{
+    uint32_t b = (value.time - from) / step;
+
+    if (acc.count > 0 && b != bucket)
+        emitBucket();
+
+    if (acc.count == 0)
+    {
+        bucket = b;
+        acc = value;
+        return;
+    }
+
+    acc.count += value.count;
+    acc.sum += value.sum;
+    if (value.min < acc.min)
+        acc.min = value.min;
+    if (value.max > acc.max)
+        acc.max = value.max;
+}
+
+/* [time, min, max, avg, count] */
+void HistoryQueryStream::emitBucket()
+{
+    if (acc.count == 0)
+        return;
+
+    if (!firstBucket)
+        out += ",";
+    firstBucket = false;
+
+    out += "[" + String(from + bucket * step);
+    out += "," + formatValue(acc.min);
+    out += "," + formatValue(acc.max);
+    out += "," + formatValue(acc.sum / acc.count);
+    out += "," + String(acc.count) + "]";
+
+    acc.count = 0;
+}
@@ -0,0 +1,59 @@
+#ifndef INCLUDE_HISTORYQUERY_H_
+#define INCLUDE_HISTORYQUERY_H_
+
+#include <user_config.h>
+#include <SmingCore/SmingCore.h>
+#include <SmingCore/DataSourceStream.h>
+#include <History.h>
+#include <SDCard.h>
+
+/*
+ * The answer to a /history request. Buckets are computed as the HTTP
+ * server asks for data, so neither the records nor the JSON ever have
+ * to fit in RAM at once. Empty buckets are left out.
+ */
+class HistoryQueryStream : public IDataSourceStream
+{
+  public:
+    HistoryQueryStream(uint8_t node, uint8_t sensor,
+                       uint32_t from, uint32_t to, uint32_t step);
+    virtual ~HistoryQueryStream();
+
+    virtual StreamType getStreamType() { return eSST_User; }
+
+    virtual uint16_t readMemoryBlock(char* data, int bufSize);
+    virtual bool seek(int len);
+    virtual bool isFinished();
+
+  private:
+    void fill(int size);
+    bool nextValue(HistoryRollup &value);
+    bool nextRecord(HistoryRollup &value);
+    bool nextRollup(HistoryRollup &value);
+    bool openDay();
+    void addValue(const HistoryRollup &value);
+    void emitBucket();
+
+  private:
+    uint8_t       node;
+    uint8_t       sensor;
+    uint32_t      from;
+    uint32_t      to;
+    uint32_t      step;
+    bool          useRollups;   // whole hours, read the .HR files
+    bool          pendingDone = false;
+
+    uint32_t      day;          // file being read
+    File          file;
+    HistoryBlock *block = NULL; // raw mode read buffer
+    uint16_t      recordIndex = 0;
+
+    uint32_t      bucket = 0;   // bucket being accumulated
+    HistoryRollup acc;
+    bool          firstBucket = true;
+
+    String        out;          // JSON not yet taken by the server
+    bool          done = false;
+};
+
+#endif //INCLUDE_HISTORYQUERY_H_
@@ -4,6 +4,9 @@
 #include <globals.h>
 #include <AppSettings.h>
 #include "IOExpansion.h"
+#include "i2c.h"
+#include "Event.h"
+#include <Perf.h>
 
 #define MCP23017_ADDRESS 0x20
 
@@ -34,148 +37,254 @@
 
 #define MCP23017_INT_ERR 255
 
-struct DigitalPin
+/* IOCON bits */
+#define MCP23017_IOCON_MIRROR 0x40
+#define MCP23017_IOCON_ODR    0x04
+
+/*
+ * With IOCON.BANK=0 (the power on default) the A and B registers of a
+ * kind are adjacent and the address pointer increments, so both ports
+ * are read or written in a single transaction: port A in the low byte,
+ * port B in the high byte of a 16 bit value.
+ */
+static bool mcp23017Read(uint8_t i2caddr, uint8_t regA, uint16_t &value)
 {
-    uint8_t id;
-    uint8_t i2caddr;
-    uint8_t pin;
-    bool    enabled;
+    Wire.beginTransmission(i2caddr);
+    Wire.write(regA);
+    if (Wire.endTransmission() != 0)
+        return false;
 
-    uint8_t bitForPin(uint8_t pin)
-    {
-        return pin%8;
-    }
+    if (Wire.requestFrom(i2caddr, (uint8_t)2) != 2)
+        return false;
+    value = Wire.read();
+    value |= (uint16_t)Wire.read() << 8;
+    return true;
+}
 
-    uint8_t regForPin(uint8_t pin, uint8_t portAaddr, uint8_t portBaddr)
-    {
-        return (pin<8) ? portAaddr : portBaddr;
-    }
+static void mcp23017Write(uint8_t i2caddr, uint8_t regA, uint16_t value)
+{
+    Wire.beginTransmission(i2caddr);
+    Wire.write(regA);
+    Wire.write((uint8_t)(value & 0xff));
+    Wire.write((uint8_t)(value >> 8));
+    Wire.endTransmission();
+}
 
-    uint8_t readRegister(uint8_t addr)
-    {
-        // read the current GPINTEN
-        Wire.beginTransmission(MCP23017_ADDRESS | i2caddr);
-        Wire.write((uint8_t)addr);
-        Wire.endTransmission();
-        Wire.requestFrom(MCP23017_ADDRESS | i2caddr, 1);
-        return Wire.read();
-    }
+/* Used when there is no IO_CONFIG_FILE */
+static const DigitalPin defaultOutputs[] =
+{
+    { 0, 0 }, { 0, 1 }, { 0, 2 }, { 0, 3 },
+    { 0, 4 }, { 0, 5 }, { 0, 6 }, { 0, 7 },
+};
 
-    void writeRegister(uint8_t regAddr, uint8_t regValue)
-    {
-        // Write the register
-        Wire.beginTransmission(MCP23017_ADDRESS | i2caddr);
-        Wire.write((uint8_t)regAddr);
-        Wire.write((uint8_t)regValue);
-        Wire.endTransmission();
-    }
+static const DigitalPin defaultInputs[] =
+{
+    { 0, 13 }, { 0, 9 }, { 0, 10 }, { 0, 11 },
+    { 0, 12 }, { 0, 8 }, { 0, 14 }, { 0, 15 },
+};
 
-    void updateRegisterBit(uint8_t pin, uint8_t pValue,
-                           uint8_t portAaddr, uint8_t portBaddr)
-    {
-        uint8_t regValue;
-        uint8_t regAddr=regForPin(pin,portAaddr,portBaddr);
-        uint8_t bit=bitForPin(pin);
-        regValue = readRegister(regAddr);
+void IOExpansion::begin()
+{
+    loadConfig();
+    rescan();
+}
 
-        // set the value for the particular bit
-        bitWrite(regValue,bit,pValue);
+/*
+ * Fill the inputs or outputs from the config, or from the defaults when
+ * there is no config. Pins that are out of range or already in use are
+ * left unused.
+ */
+void IOExpansion::loadPins(JsonArray &config, const DigitalPin *defaults,
+                           uint8_t numDefaults, bool outputs)
+{
+    int num = config.success() ? config.size() : numDefaults;
+    DigitalPin *pins;
 
-        writeRegister(regAddr,regValue);
-    }
+    num = min(num, IO_MAX_DIGITAL);
+    pins = new DigitalPin[num];
 
-    void pinMode(uint8_t d)
+    for (int i = 0; i < num; i++)
     {
-        updateRegisterBit(pin,(d==INPUT),MCP23017_IODIRA,MCP23017_IODIRB);
-    }
+        int expander = -1;
+        int pin = -1;
 
-    uint8_t readGPIO(uint8_t b)
-    {
-        // read the current GPIO output latches
-        Wire.beginTransmission(MCP23017_ADDRESS | i2caddr);
-        if (b == 0)
-            Wire.write((uint8_t)MCP23017_GPIOA);
+        if (config.success())
+        {
+            JsonArray &entry = config[i];
+            if (entry.size() == 2)
+            {
+                expander = entry[0];
+                pin = entry[1];
+            }
+        }
         else
         {
-            Wire.write((uint8_t)MCP23017_GPIOB);
+            expander = defaults[i].expander;
+            pin = defaults[i].pin;
         }
-        Wire.endTransmission();
-
-        Wire.requestFrom(MCP23017_ADDRESS | i2caddr, 1);
-        return Wire.read();
-    }
-
-    void digitalWrite(uint8_t d)
-    {
-        uint8_t gpio;
-        uint8_t bit=bitForPin(pin);
 
-        // read the current GPIO output latches
-        uint8_t regAddr=regForPin(pin,MCP23017_OLATA,MCP23017_OLATB);
-        gpio = readRegister(regAddr);
+        pins[i].expander = IO_PIN_UNUSED;
+        if (expander < 0 || expander >= MCP23017_EXPANDERS ||
+            pin < 0 || pin > 15)
+            continue;
 
-        // set the pin and direction
-        bitWrite(gpio,bit,d);
+        if (pinMap[expander][pin])
+        {
+            Debug.printf("%sD%d: pin %d of %x is in use already\n",
+                         outputs ? "output" : "input", i + 1, pin,
+                         MCP23017_ADDRESS + expander);
+            continue;
+        }
 
-        // write the new GPIO
-        regAddr=regForPin(pin,MCP23017_GPIOA,MCP23017_GPIOB);
-        writeRegister(regAddr,gpio);
+        pins[i].expander = expander;
+        pins[i].pin = pin;
+        pinMap[expander][pin] = (i + 1) | (outputs ? IO_MAP_OUTPUT : 0);
     }
 
-    void pullUp(uint8_t d)
+    if (outputs)
     {
-        updateRegisterBit(pin,d,MCP23017_GPPUA,MCP23017_GPPUB);
+        delete[] digitalOutputs;
+        digitalOutputs = pins;
+        numDigitalOutputs = num;
     }
-
-    uint8_t digitalRead()
+    else
     {
-        uint8_t bit=bitForPin(pin);
-        uint8_t regAddr=regForPin(pin,MCP23017_GPIOA,MCP23017_GPIOB);
-        return (readRegister(regAddr) >> bit) & 0x1;
+        delete[] digitalInputs;
+        digitalInputs = pins;
+        numDigitalInputs = num;
     }
+}
+
+void IOExpansion::loadAnalogChannels(JsonArray &config)
+{
+    uint32_t now = millis();
 
-    bool checkState()
+    for (int i = 0; i < PCF8591_CHANNELS; i++)
     {
-        bool newEnabled = digitalRead() > 0 ? true : false;
-        if (newEnabled != enabled)
+        AnalogChannel &ch = analogChannels[i];
+
+        ch.interval = ANALOG_INTERVAL_MS;
+        ch.oversample = 1;
+        ch.median = false;
+        ch.emaShift = 0;
+        ch.deadband = 0;
+
+        if (config.success() && i < config.size())
         {
-            enabled = newEnabled;
-            return true;
+            JsonObject &entry = config[i];
+
+            if (entry.containsKey("interval"))
+                ch.interval = max((long)entry["interval"], (long)ANALOG_TICK_MS);
+            if (entry.containsKey("oversample"))
+                ch.oversample = constrain((int)entry["oversample"], 1,
+                                          PCF8591_MAX_OVERSAMPLE);
+            if (entry.containsKey("filter"))
+                ch.median = String((const char *)entry["filter"]) == "median";
+            if (entry.containsKey("ema"))
+                ch.emaShift = constrain((int)entry["ema"], 0, 7);
+            if (entry.containsKey("deadband"))
+                ch.deadband = constrain((int)entry["deadband"], 0, 255);
         }
-        return false;
+
+        ch.due = now;
+        ch.publishedAt = now;
+        ch.valid = false;
     }
-};
+}
 
-DigitalPin DigitalOutputPins[] =
+/* Takes effect on the next rescan() */
+void IOExpansion::loadConfig()
 {
-    { 1, 0x20, 0}, // expander 0x20 pin 0
-    { 2, 0x20, 1}, // expander 0x20 pin 1
-    { 3, 0x20, 2}, // expander 0x20 pin 2
-    { 4, 0x20, 3}, // expander 0x20 pin 3
-    { 5, 0x20, 4}, // expander 0x20 pin 4
-    { 6, 0x20, 5}, // expander 0x20 pin 5
-    { 7, 0x20, 6}, // expander 0x20 pin 6
-    { 8, 0x20, 7}, // expander 0x20 pin 7
-};
+    DynamicJsonBuffer jsonBuffer;
+    char* jsonString = NULL;
 
-DigitalPin DigitalInputPins[] =
+    memset(pinMap, 0, sizeof(pinMap));
+
+    if (fileExist(IO_CONFIG_FILE))
+    {
+        int size = fileGetSize(IO_CONFIG_FILE);
+        jsonString = new char[size + 1];
+        fileGetContent(IO_CONFIG_FILE, jsonString, size + 1);
+    }
+
+    JsonObject& root = jsonString ? jsonBuffer.parseObject(jsonString) :
+                                    JsonObject::invalid();
+    if (jsonString && !root.success())
+        Debug.printf("%s is not valid, using the default pins\n",
+                     IO_CONFIG_FILE);
+
+    loadPins(root["outputs"], defaultOutputs,
+             sizeof(defaultOutputs)/sizeof(DigitalPin), true);
+    loadPins(root["inputs"], defaultInputs,
+             sizeof(defaultInputs)/sizeof(DigitalPin), false);
+    loadAnalogChannels(root["analog"]);
+
+    delete[] jsonString;
+}
+
+/*
+ * Set the pin directions and interrupts of an expander from the pin map.
+ * The output latches of a new expander are read into the shadow, one
+ * that was there already gets the shadow written back, so outputs keep
+ * their state across a rescan.
+ */
+void IOExpansion::configureExpander(uint8_t expander, bool known)
 {
-    { 1, 0x20, 13}, // expander 0x20 pin 0
-    { 2, 0x20, 9},  // expander 0x20 pin 0
-    { 3, 0x20, 10}, // expander 0x20 pin 0
-    { 4, 0x20, 11}, // expander 0x20 pin 0
-    { 5, 0x20, 12}, // expander 0x20 pin 0
-    { 6, 0x20, 8},  // expander 0x20 pin 0
-    { 7, 0x20, 14}, // expander 0x20 pin 0
-    { 8, 0x20, 15}, // expander 0x20 pin 0
-};
+    uint8_t address = MCP23017_ADDRESS + expander;
+    uint16_t iodir = 0xffff;
+    uint16_t inputs = 0;
+    uint16_t states;
+
+    for (int pin = 0; pin < 16; pin++)
+    {
+        if (pinMap[expander][pin] & IO_MAP_OUTPUT)
+            iodir &= ~(1 << pin);
+        else if (pinMap[expander][pin])
+            inputs |= 1 << pin;
+    }
+    mcp23017Outputs[expander] = ~iodir;
+
+    Wire.lock();
+    if (known)
+        mcp23017Write(address, MCP23017_OLATA, mcp23017Latches[expander]);
+    mcp23017Write(address, MCP23017_IODIRA, iodir);
+#ifdef MCP23017_INT_PIN
+    /*
+     * Interrupt on any change of an input pin. INTA and INTB are
+     * mirrored and open drain, so all expanders can share one line.
+     * Reading GPIO below clears anything already pending.
+     */
+    Wire.beginTransmission(address);
+    Wire.write((uint8_t)MCP23017_IOCONA);
+    Wire.write((uint8_t)(MCP23017_IOCON_MIRROR | MCP23017_IOCON_ODR));
+    Wire.endTransmission();
+    mcp23017Write(address, MCP23017_INTCONA, 0);
+    mcp23017Write(address, MCP23017_GPINTENA, inputs);
+#endif
+    if ((!known &&
+         !mcp23017Read(address, MCP23017_OLATA, mcp23017Latches[expander])) ||
+        !mcp23017Read(address, MCP23017_GPIOA, states))
+    {
+        Debug.printf("MCP23017 expander at %x not responding\n", address);
+        states = mcp23017States[expander];
+    }
+    Wire.unlock();
+
+    /* A new expander is taken as it is, like at startup */
+    updateDigitalPins(expander, states, known);
+}
 
-void IOExpansion::begin(IOChangeDelegate dlg)
+/*
+ * Look for expanders, at startup and again whenever asked to. New ones
+ * are set up, ones that are gone are no longer polled and their pins
+ * read as off.
+ */
+void IOExpansion::rescan()
 {
     byte error, address;
-    uint8_t input = 0;
-    uint8_t output = 0;
-    changeDlg = dlg;
+
+    digitalFound = FALSE;
+    analogFound = FALSE;
 
     /*
      * MCP23017 16-bit port expanders
@@ -183,69 +292,32 @@ void IOExpansion::begin(IOChangeDelegate dlg)
      */
     for (address = 0x20; address <= 0x26; address++)
     {
-        uint8_t data;
+        uint8_t expander = address - MCP23017_ADDRESS;
+        bool known = mcp23017Present[expander];
 
         /* Let the watchdog know we're not crashed */
 	WDT.alive();
 
-        /* Lock the I2C bus */
-        Wire.lock();
-
         /* Check whether the device responds, if not it's not present */
+        Wire.lock();
         Wire.beginTransmission(address);
 	error = Wire.endTransmission();
+        Wire.unlock();
 
 	if (error != 0)
 	{
-            Wire.unlock();
+            if (known)
+                Debug.printf("MCP23017 expander at %x is gone\n", address);
+            mcp23017Present[expander] = false;
             continue;
         }
 
-        digitalFound = TRUE;
-
-        Debug.printf("Found MCP23017 expander at %x\n", address);
-        mcp23017Present[address - 0x20] = true;
-
-        /* Unlock the I2C bus */
-        Wire.unlock();        
-    }
-
-    for (int i=0; i<(sizeof(DigitalInputPins)/sizeof(DigitalPin)); i++)
-    {
-        DigitalPin *pPin = &DigitalInputPins[i];
-
-        /* Let the watchdog know we're not crashed */
-	WDT.alive();
-
-        if (pPin->i2caddr == 0)
-            continue;
-
-        if (!mcp23017Present[pPin->i2caddr - 0x20])
-            continue;
-
-        Wire.lock();
-        pPin->pinMode(INPUT);
-        pPin->checkState();
-        Wire.unlock();
-    }
-    
-    for (int i=0; i<(sizeof(DigitalOutputPins)/sizeof(DigitalPin)); i++)
-    {
-        DigitalPin *pPin = &DigitalOutputPins[i];
-
-        /* Let the watchdog know we're not crashed */
-	WDT.alive();
-
-        if (pPin->i2caddr == 0)
-            continue;
-
-        if (!mcp23017Present[pPin->i2caddr - 0x20])
-            continue;
+        if (!known)
+            Debug.printf("Found MCP23017 expander at %x\n", address);
 
-        Wire.lock();
-        pPin->pinMode(OUTPUT);
-        pPin->checkState();
-        Wire.unlock();
+        digitalFound = TRUE;
+        mcp23017Present[expander] = true;
+        configureExpander(expander, known);
     }
 
     for (address = 0x48; address <= 0x4f; address++)
@@ -259,23 +331,30 @@ void IOExpansion::begin(IOChangeDelegate dlg)
 
 	if (error == 0)
 	{
-            /*
-             * PCF8591 D/A and A/D expanders
-             *
-             * 8 of these are supported, with addresses from 0x48 to 0x4f.
-             * These are configured so that port A are all outputs and
-             * port B are all inputs.
-             */
-            Debug.printf("Found PCF8591 expander at %x\n", address);
-            pcf8591Present[address - 0x48] = true;
             analogFound = TRUE;
-
-            /* The output value can not be read back, so init to 0. */
-            Wire.beginTransmission(address); // wake up PCF8591
-            Wire.write(0x40); // control byte - turn on DAC (binary 1000000)
-            Wire.write(0); // value to send to DAC
-            Wire.endTransmission(); // end tranmission
-            pcf8591Outputs[address - 0x48] = 0;
+            if (!pcf8591Present[address - 0x48])
+            {
+                /*
+                 * PCF8591 D/A and A/D expanders
+                 *
+                 * 8 of these are supported, with addresses from 0x48 to
+                 * 0x4f. These are configured so that port A are all
+                 * outputs and port B are all inputs.
+                 */
+                Debug.printf("Found PCF8591 expander at %x\n", address);
+                pcf8591Present[address - 0x48] = true;
+
+                /* The output value can not be read back, so init to 0. */
+                Wire.beginTransmission(address); // wake up PCF8591
+                Wire.write(0x40); // control byte - turn on DAC (binary 1000000)
+                Wire.write(0); // value to send to DAC
+                Wire.endTransmission(); // end tranmission
+                pcf8591Outputs[address - 0x48] = 0;
+            }
+        }
+        else
+        {
+            pcf8591Present[address - 0x48] = false;
         }
 
         Wire.unlock();
@@ -283,12 +362,29 @@ void IOExpansion::begin(IOChangeDelegate dlg)
 
     if (digitalFound)
     {
+#ifdef MCP23017_INT_PIN
+        pinMode(MCP23017_INT_PIN, INPUT_PULLUP);
+        i2cDigitalInterruptTimer.initializeMs(MCP23017_INT_CHECK_MS, TimerDelegate(&IOExpansion::i2cCheckDigitalInterrupt, this)).start(true);
+        i2cCheckDigitalTimer.initializeMs(MCP23017_SAFETY_POLL_MS, TimerDelegate(&IOExpansion::i2cCheckDigitalState, this)).start(true);
+#else
         i2cCheckDigitalTimer.initializeMs(100, TimerDelegate(&IOExpansion::i2cCheckDigitalState, this)).start(true);
+#endif
+    }
+    else
+    {
+#ifdef MCP23017_INT_PIN
+        i2cDigitalInterruptTimer.stop();
+#endif
+        i2cCheckDigitalTimer.stop();
     }
 
     if (analogFound)
     {
-        i2cCheckAnalogTimer.initializeMs(10000, TimerDelegate(&IOExpansion::i2cCheckAnalogState, this)).start(true);
+        i2cCheckAnalogTimer.initializeMs(ANALOG_TICK_MS, TimerDelegate(&IOExpansion::i2cCheckAnalogState, this)).start(true);
+    }
+    else
+    {
+        i2cCheckAnalogTimer.stop();
     }
 
     if (!digitalFound && !analogFound)
@@ -297,269 +393,420 @@ void IOExpansion::begin(IOChangeDelegate dlg)
     }
 }
 
-void IOExpansion::i2cCheckDigitalState()
+void IOExpansion::print(CommandOutput* out)
 {
-    static int forcePublish = FORCE_PUBLISH_DIG_IVL;
-
-    forcePublish--;
+    for (int i = 0; i < MCP23017_EXPANDERS; i++)
+    {
+        if (mcp23017Present[i])
+            out->printf("MCP23017 at %x\r\n", MCP23017_ADDRESS + i);
+    }
+    for (int i = 0; i < PCF8591_EXPANDERS; i++)
+    {
+        if (pcf8591Present[i])
+            out->printf("PCF8591 at %x\r\n", 0x48 + i);
+    }
 
-    for (int i=0; i<(sizeof(DigitalInputPins)/sizeof(DigitalPin)); i++)
+    for (int o = 0; o < 2; o++)
     {
-        DigitalPin *pPin = &DigitalInputPins[i];
-        bool changed;
-        bool enabled;
+        bool output = o == 1;
+        uint8_t num = output ? numDigitalOutputs : numDigitalInputs;
 
-        /* Let the watchdog know we're not crashed */
-	WDT.alive();
+        for (int id = 1; id <= num; id++)
+        {
+            DigitalPin *pPin = output ? &digitalOutputs[id - 1] :
+                                        &digitalInputs[id - 1];
+
+            if (pPin->expander == IO_PIN_UNUSED)
+                continue;
+
+            out->printf("%sD%-3d: %x pin %-2d %s\r\n",
+                        output ? "output" : "input ", id,
+                        MCP23017_ADDRESS + pPin->expander, pPin->pin,
+                        !mcp23017Present[pPin->expander] ? "(not present)" :
+                        (mcp23017States[pPin->expander] & (1 << pPin->pin)) ?
+                        "on" : "off");
+        }
+    }
+}
 
-        if (pPin->i2caddr == 0)
-            continue;
+void IOExpansion::notifyDigital(bool output, uint8_t id, bool enabled)
+{
+    const char *name = output ? "outputD" : "inputD";
 
-        if (!mcp23017Present[pPin->i2caddr - 0x20])
-            continue;
+    Debug.printf("%s%d => %s\n", name, id, enabled ? "on" : "off");
 
-        Wire.lock();
-        changed = pPin->checkState();
-        enabled = pPin->enabled;
-        Wire.unlock();
-        
-        if (changed)
-        {
-            Debug.printf("inputD%d => %s\n", pPin->id,
-                         enabled ? "on" : "off");
+    Events.publishDigital(output, id, enabled);
+}
 
-            if (changeDlg)
-                changeDlg(String("inputD") + String(pPin->id),
-                          enabled ? "on" : "off");
-        }
-    }
+/*
+ * Take new port states of an expander, reporting the mapped pins that
+ * changed if asked to.
+ */
+void IOExpansion::updateDigitalPins(uint8_t expander, uint16_t states,
+                                    bool notify)
+{
+    uint16_t changed = states ^ mcp23017States[expander];
 
-    for (int i=0; i<(sizeof(DigitalOutputPins)/sizeof(DigitalPin)); i++)
-    {
-        DigitalPin *pPin = &DigitalOutputPins[i];
-        bool changed;
-        bool enabled;
+    mcp23017States[expander] = states;
+    if (!notify)
+        return;
 
-        /* Let the watchdog know we're not crashed */
-	WDT.alive();
+    for (int pin = 0; changed; pin++, changed >>= 1)
+    {
+        uint8_t id = pinMap[expander][pin];
 
-        if (pPin->i2caddr == 0)
+        if (!(changed & 1) || !id)
             continue;
 
-        if (!mcp23017Present[pPin->i2caddr - 0x20])
-            continue;
+        notifyDigital(id & IO_MAP_OUTPUT, id & ~IO_MAP_OUTPUT,
+                      states & (1 << pin));
+    }
+}
 
-        Wire.lock();
-        changed = pPin->checkState();
-        enabled = pPin->enabled;
-        Wire.unlock();
+/*
+ * Both ports of an expander are read in one transaction, and only when
+ * that differs from the previous read the pins are looked at. The reads
+ * are queued on the I2C bus, an expander that still has one waiting is
+ * skipped.
+ */
+void IOExpansion::i2cCheckDigitalState()
+{
+    static int forcePublish = FORCE_PUBLISH_DIG_IVL;
 
-        if (changed)
-        {
-            Debug.printf("outputD%d => %s\n",  pPin->id,
-                         enabled ? "on" : "off");
+    forcePublish--;
 
-            if (changeDlg)
-                changeDlg(String("outputD") + String(pPin->id),
-                          enabled ? "on" : "off");
-        }
+    for (int i = 0; i < MCP23017_EXPANDERS; i++)
+    {
+        if (!mcp23017Present[i] || (mcp23017Reading & (1 << i)))
+            continue;
+
+        if (I2CBus.read(MCP23017_ADDRESS + i, MCP23017_GPIOA, 2,
+                        I2C_PRIO_INPUT,
+                        I2CDoneDelegate(&IOExpansion::onDigitalStates, this)))
+            mcp23017Reading |= 1 << i;
     }
 
     if (forcePublish == 0)
         forcePublish = FORCE_PUBLISH_DIG_IVL;
 }
 
-bool IOExpansion::getDigOutput(uint8_t output)
+/*
+ * Outputs are taken from the shadowed latches rather than from what was
+ * read, a write queued behind this read would otherwise look undone.
+ */
+void IOExpansion::onDigitalStates(I2CRequest &request)
 {
-    bool enabled = false;
-
-    for (int i=0; i<(sizeof(DigitalOutputPins)/sizeof(DigitalPin)); i++)
-    {
-        DigitalPin *pPin = &DigitalOutputPins[i];
+    uint8_t expander = request.address - MCP23017_ADDRESS;
+    uint16_t outputs = mcp23017Outputs[expander];
+    uint16_t states;
+
+    mcp23017Reading &= ~(1 << expander);
+    if (request.status != 0 || !mcp23017Present[expander])
+        return;
+
+    states = request.data[0] | ((uint16_t)request.data[1] << 8);
+    states = (states & ~outputs) | (mcp23017Latches[expander] & outputs);
+    if (states != mcp23017States[expander])
+        updateDigitalPins(expander, states, true);
+}
 
-        /* Let the watchdog know we're not crashed */
-	WDT.alive();
+#ifdef MCP23017_INT_PIN
+/*
+ * An expander keeps INT low until INTCAP or GPIO is read, so looking at
+ * the line from a timer misses nothing and keeps the I2C traffic out of
+ * interrupt context. While it is high the bus is not touched at all.
+ */
+void IOExpansion::i2cCheckDigitalInterrupt()
+{
+    if (digitalRead(MCP23017_INT_PIN) != LOW || mcp23017Servicing)
+        return;
 
-        if (pPin->id != output)
+    for (int i = 0; i < MCP23017_EXPANDERS; i++)
+    {
+        if (!mcp23017Present[i])
             continue;
 
-        if (!mcp23017Present[pPin->i2caddr - 0x20])
-            break;
-
-        Wire.lock();
-        enabled = pPin->enabled;
-        Wire.unlock();
-
-        return enabled;
+        if (I2CBus.read(MCP23017_ADDRESS + i, MCP23017_INTFA, 4,
+                        I2C_PRIO_INPUT,
+                        I2CDoneDelegate(&IOExpansion::onDigitalInterrupt, this)))
+            mcp23017Servicing |= 1 << i;
     }
-
-    Debug.printf("invalid output %d!!!!\n", output);
-    return false;
 }
 
-bool IOExpansion::setDigOutput(uint8_t output, bool enable)
+/*
+ * INTF and INTCAP are read together, which clears the interrupt. INTCAP
+ * holds the pins as they were when the first change happened, GPIO is
+ * read next so that a press released in the meantime is seen as both.
+ */
+void IOExpansion::onDigitalInterrupt(I2CRequest &request)
 {
-    bool success = false;
+    uint8_t expander = request.address - MCP23017_ADDRESS;
+    uint16_t flags;
+    uint16_t captured;
 
-    for (int i=0; i<(sizeof(DigitalOutputPins)/sizeof(DigitalPin)); i++)
-    {
-        DigitalPin *pPin = &DigitalOutputPins[i];
+    mcp23017Servicing &= ~(1 << expander);
+    if (request.status != 0 || !mcp23017Present[expander])
+        return;
 
-        /* Let the watchdog know we're not crashed */
-	WDT.alive();
+    flags = request.data[0] | ((uint16_t)request.data[1] << 8);
+    captured = request.data[2] | ((uint16_t)request.data[3] << 8);
+    if (!flags)
+        return;
 
-        if (pPin->id != output)
-            continue;
+    PERF_SCOPE(PERF_IO_INPUT);
 
-        if (!mcp23017Present[pPin->i2caddr - 0x20])
-            break;
+    updateDigitalPins(expander,
+                      (mcp23017States[expander] & ~flags) | (captured & flags),
+                      true);
 
-        Wire.lock();
-        pPin->digitalWrite(enable ? 1 : 0);
-        Wire.unlock();
+    if (!(mcp23017Reading & (1 << expander)) &&
+        I2CBus.read(request.address, MCP23017_GPIOA, 2, I2C_PRIO_INPUT,
+                    I2CDoneDelegate(&IOExpansion::onDigitalStates, this)))
+        mcp23017Reading |= 1 << expander;
+}
+#endif
+
+/* NULL if the ID is not mapped or its expander is not there */
+DigitalPin *IOExpansion::getDigitalPin(bool output, uint8_t id)
+{
+    DigitalPin *pPin;
 
-        Debug.printf("outputD%d => %s\n",  pPin->id,
-                     pPin->enabled ? "on" : "off");
-        if (changeDlg)
-            changeDlg(String("outputD") + String(pPin->id),
-                      pPin->enabled ? "on" : "off");
+    if (id < 1 || id > (output ? numDigitalOutputs : numDigitalInputs))
+        return NULL;
 
-        success = true;
-        break;
-    }
+    pPin = output ? &digitalOutputs[id - 1] : &digitalInputs[id - 1];
+    if (pPin->expander == IO_PIN_UNUSED || !mcp23017Present[pPin->expander])
+        return NULL;
+    return pPin;
+}
+
+bool IOExpansion::getDigOutput(uint8_t output)
+{
+    DigitalPin *pPin = getDigitalPin(true, output);
 
-    if (!success)
+    if (!pPin)
     {
         Debug.printf("invalid output %d!!!!\n", output);
         return false;
     }
 
-    return true;
+    return (mcp23017States[pPin->expander] & (1 << pPin->pin)) != 0;
 }
 
-bool IOExpansion::toggleDigOutput(uint8_t output)
+/*
+ * The latches are shadowed, so this is a single one byte write, queued
+ * on the I2C bus. The pin state is updated right away, but only once
+ * the write is queued: otherwise nothing changes and false is returned.
+ */
+bool IOExpansion::writeDigOutput(DigitalPin *pPin, bool enable)
 {
-    bool success = false;
+    uint8_t expander = pPin->expander;
+    uint16_t mask = 1 << pPin->pin;
+    uint16_t latches = mcp23017Latches[expander];
 
-    for (int i=0; i<(sizeof(DigitalOutputPins)/sizeof(DigitalPin)); i++)
-    {
-        DigitalPin *pPin = &DigitalOutputPins[i];
+    if (enable)
+        latches |= mask;
+    else
+        latches &= ~mask;
 
-        /* Let the watchdog know we're not crashed */
-	WDT.alive();
+    uint8_t port = pPin->pin < 8 ? 0 : 1;
+    uint8_t latch = latches >> (8 * port);
+    if (!I2CBus.write(MCP23017_ADDRESS + expander, MCP23017_OLATA + port,
+                      &latch, 1, I2C_PRIO_OUTPUT))
+    {
+        Debug.printf("pin %d of %x not written, I2C queue full\n",
+                     pPin->pin, MCP23017_ADDRESS + expander);
+        return false;
+    }
 
-        if (pPin->id != output)
-            continue;
+    mcp23017Latches[expander] = latches;
+    if (enable)
+        mcp23017States[expander] |= mask;
+    else
+        mcp23017States[expander] &= ~mask;
+    return true;
+}
 
-        if (!mcp23017Present[pPin->i2caddr - 0x20])
-            break;
+bool IOExpansion::setDigOutput(uint8_t output, bool enable)
+{
+    DigitalPin *pPin = getDigitalPin(true, output);
 
-        Wire.lock();
-        pPin->digitalWrite(pPin->enabled ? 0 : 1);
-        Wire.unlock();
+    if (!pPin)
+    {
+        Debug.printf("invalid output %d!!!!\n", output);
+        return false;
+    }
 
-        Debug.printf("outputD%d => %s\n",  pPin->id,
-                     pPin->enabled ? "on" : "off");
-        if (changeDlg)
-            changeDlg(String("outputD") + String(pPin->id),
-                      pPin->enabled ? "on" : "off");
+    if (!writeDigOutput(pPin, enable))
+        return false;
+    notifyDigital(true, output, enable);
+    return true;
+}
 
-        success = true;
-        break;
-    }
+bool IOExpansion::toggleDigOutput(uint8_t output)
+{
+    DigitalPin *pPin = getDigitalPin(true, output);
 
-    if (!success)
+    if (!pPin)
     {
         Debug.printf("invalid output %d!!!!\n", output);
         return false;
     }
 
+    bool enable = !(mcp23017States[pPin->expander] & (1 << pPin->pin));
+    if (!writeDigOutput(pPin, enable))
+        return false;
+    notifyDigital(true, output, enable);
     return true;
 }
 
 bool IOExpansion::getDigInput(uint8_t input)
 {
-    bool enabled = false;
+    DigitalPin *pPin = getDigitalPin(false, input);
 
-    for (int i=0; i<(sizeof(DigitalInputPins)/sizeof(DigitalPin)); i++)
+    if (!pPin)
     {
-        DigitalPin *pPin = &DigitalInputPins[i];
+        Debug.printf("invalid input %d!!!!\n", input);
+        return false;
+    }
 
-        /* Let the watchdog know we're not crashed */
-	WDT.alive();
+    return (mcp23017States[pPin->expander] & (1 << pPin->pin)) != 0;
+}
 
-        if (pPin->id != input)
-            continue;
+/* Mean or median of a burst, as value << 8 */
+static uint16_t reduceSamples(uint8_t *values, int n, bool median)
+{
+    uint16_t sum = 0;
 
-        if (!mcp23017Present[pPin->i2caddr - 0x20])
-            break;
+    if (!median)
+    {
+        for (int i = 0; i < n; i++)
+            sum += values[i];
+        return ((uint32_t)sum << 8) / n;
+    }
 
-        Wire.lock();
-        enabled = pPin->enabled;
-        Wire.unlock();
+    for (int i = 1; i < n; i++)
+    {
+        uint8_t v = values[i];
+        int j = i;
 
-        return enabled;
+        for (; j > 0 && values[j - 1] > v; j--)
+            values[j] = values[j - 1];
+        values[j] = v;
     }
 
-    Debug.printf("invalid input %d!!!!\n", input);
-    return false;
+    if (n & 1)
+        return values[n / 2] << 8;
+    return (values[n / 2 - 1] + values[n / 2]) << 7;
 }
 
-void IOExpansion::i2cPublishPcfInputs(byte address, bool forcePublish)
+/*
+ * Filter the samples of one channel from a burst and publish the result
+ * if it moved out of the deadband.
+ */
+void IOExpansion::filterAnalog(uint8_t channel, const uint8_t *burst,
+                               int rounds)
 {
-    byte value[4];
-
-    /* read the actual values */
-    Wire.beginTransmission(address); // wake up PCF8591
-    Wire.write(0x04); // control byte - read ADC0 then auto-increment
-    Wire.endTransmission(); // end tranmission
-    Wire.requestFrom(address, 5);
-    value[0]=Wire.read();
-    value[0]=Wire.read();
-    value[1]=Wire.read();
-    value[2]=Wire.read();
-    value[3]=Wire.read();
+    AnalogChannel &ch = analogChannels[channel];
+    uint8_t values[PCF8591_MAX_OVERSAMPLE];
+    int n = min((int)ch.oversample, rounds);
+    uint32_t now = millis();
+
+    for (int k = 0; k < n; k++)
+        values[k] = burst[4 * k + (channel % 4)];
+
+    uint16_t value = reduceSamples(values, n, ch.median);
+    if (!ch.valid || ch.emaShift == 0)
+        ch.filtered = value;
+    else
+        ch.filtered += ((int32_t)value - ch.filtered) >> ch.emaShift;
+
+    uint8_t rounded = (ch.filtered + 0x80) >> 8;
+    if (ch.valid &&
+        abs((int)rounded - pcf8591Inputs[channel]) <= ch.deadband &&
+        now - ch.publishedAt < FORCE_PUBLISH_ANALOG_IVL * 10000UL)
+        return;
+
+    ch.valid = true;
+    ch.publishedAt = now;
+    pcf8591Inputs[channel] = rounded;
+
+    Events.publishAnalog(channel + 1, rounded);
+}
+
+/*
+ * The first byte read is the previous conversion, the four channels
+ * follow round and round thanks to the auto increment.
+ */
+void IOExpansion::onPcfInputs(I2CRequest &request)
+{
+    uint8_t pcf = request.address - 0x48;
+    uint8_t due = (analogDue >> (4 * pcf)) & 0x0f;
+
+    pcf8591Reading &= ~(1 << pcf);
+    analogDue &= ~((uint32_t)0x0f << (4 * pcf));
+    if (request.status != 0 || !pcf8591Present[pcf])
+        return;
 
     for (int j = 0; j < 4; j++)
     {
-        if (forcePublish ||
-            pcf8591Inputs[j + (4 * (address - 0x48))] != value[j])
-        {
-            if (changeDlg)
-                changeDlg(String("inputA") +
-                          String((j + 1) + (4 * (address - 0x48))),
-                          String(value[j]));
-        }
-        pcf8591Inputs[j + (4 * (address - 0x48))] = value[j];
+        if (due & (1 << j))
+            filterAnalog(4 * pcf + j, &pcf8591Bursts[pcf][1],
+                         (request.readLen - 1) / 4);
     }
 }
 
+/*
+ * Runs every ANALOG_TICK_MS. A PCF8591 with channels due is read in one
+ * burst, long enough for the channel that oversamples most.
+ */
 void IOExpansion::i2cCheckAnalogState()
 {
-    static int forcePublish = FORCE_PUBLISH_ANALOG_IVL;
-
-    Wire.lock();
+    uint32_t now = millis();
 
-    forcePublish--;
-    for (int i = 0; i < 8; i++)
+    for (int i = 0; i < PCF8591_EXPANDERS; i++)
     {
-        if (pcf8591Present[i])
+        uint8_t due = 0;
+        int rounds = 1;
+
+        if (!pcf8591Present[i] || (pcf8591Reading & (1 << i)))
+            continue;
+
+        for (int j = 0; j < 4; j++)
         {
-            i2cPublishPcfInputs(0x48 + i, (forcePublish == 0));
+            AnalogChannel &ch = analogChannels[4 * i + j];
+
+            if ((int32_t)(now - ch.due) < 0)
+                continue;
+
+            due |= 1 << j;
+            rounds = max(rounds, (int)ch.oversample);
+
+            /* Keep the pace, unless too far behind */
+            ch.due += ch.interval;
+            if ((int32_t)(now - ch.due) >= 0)
+                ch.due = now + ch.interval;
         }
-    }
 
-    if (forcePublish == 0)
-        forcePublish = FORCE_PUBLISH_ANALOG_IVL;
+        if (!due)
+            continue;
 
-    Wire.unlock();
+        /* control byte - read ADC0 then auto-increment */
+        if (I2CBus.read(0x48 + i, 0x04, 1 + 4 * rounds, I2C_PRIO_INPUT,
+                        I2CDoneDelegate(&IOExpansion::onPcfInputs, this),
+                        pcf8591Bursts[i]))
+        {
+            pcf8591Reading |= 1 << i;
+            analogDue |= (uint32_t)due << (4 * i);
+        }
+    }
 }
 
 bool IOExpansion::updateResource(String resource, String value)
 {
     if (resource.startsWith("outputD"))
     {
-        resource = resource.substring(6);
+        resource = resource.substring(7);
         int out = resource.toInt();
         bool result = setDigOutput(out, value.equals("on"));
         Debug.printf("Set digital output: [%d] %s%s\n",
@@ -595,7 +842,7 @@ String IOExpansion::getResourceValue(String resource)
     {
         resource = resource.substring(6);
         int input = resource.toInt();
-        if (input < 1 || input > 32)
+        if (input < 1 || input > PCF8591_CHANNELS)
         {
             Debug.printf("invalid input: d%d", input);
             return "invalid";
@@ -623,7 +870,7 @@ bool IOExpansion::toggleResourceValue(String resource)
 {
     if (resource.startsWith("outputD"))
     {
-        resource = resource.substring(6);
+        resource = resource.substring(7);
         int out = resource.toInt();
         bool result = toggleDigOutput(out);
         Debug.printf("Toggle digital output: [%d]%s\n",
@@ -9,48 +9,148 @@
 #define FORCE_PUBLISH_DIG_IVL 600
 #define FORCE_PUBLISH_ANALOG_IVL 60
 
-typedef Delegate<void(String, String)> IOChangeDelegate;
+#ifdef MCP23017_INT_PIN
+#define MCP23017_INT_CHECK_MS   5    // how often the INT line is looked at
+#define MCP23017_SAFETY_POLL_MS 2000 // full read of all ports
+#endif
+
+#define MCP23017_EXPANDERS 7         // addresses 0x20 to 0x26
+#define PCF8591_EXPANDERS  8         // addresses 0x48 to 0x4f
+#define PCF8591_CHANNELS   (PCF8591_EXPANDERS * 4)
+#define IO_MAX_DIGITAL     (MCP23017_EXPANDERS * 16)
+
+#define ANALOG_TICK_MS         100   // resolution of the sample intervals
+#define ANALOG_INTERVAL_MS     10000 // default sample interval
+#define PCF8591_MAX_OVERSAMPLE 7     // 1 + 4 * 7 bytes fit one Wire read
+
+/*
+ * The digital pin map, read from IO_CONFIG_FILE. inputD<n> and
+ * outputD<n> are entry n - 1 of the inputs and outputs arrays, each
+ * entry is [expander, pin] with expander 0 to 6 for address 0x20 to
+ * 0x26 and pin 0 to 15 (GPA0 to GPB7). An empty entry leaves an ID
+ * unused:
+ *
+ *   { "inputs": [[0, 13], [0, 9]], "outputs": [[0, 0], [], [1, 7]] }
+ *
+ * Without the file expander 0x20 is used with 8 outputs and 8 inputs.
+ *
+ * The analog array sets how inputA<n> is sampled, entry n - 1 again.
+ * Missing entries and fields keep the defaults shown:
+ *
+ *   "analog": [{ "interval": 10000, "oversample": 1, "filter": "mean",
+ *                "ema": 0, "deadband": 0 }]
+ *
+ * Every interval ms 'oversample' samples (up to 7) are taken in one
+ * burst and reduced to their mean or median. 'ema' smooths that over
+ * time with a weight of 1 / 2^ema for the new value. A value is only
+ * published when it moved more than 'deadband' from the last published
+ * one, or when that was FORCE_PUBLISH_ANALOG_IVL * 10 s ago.
+ */
+#define IO_CONFIG_FILE     ".io.conf"
+
+#define IO_PIN_UNUSED      0xff      // DigitalPin.expander of a gap
+#define IO_MAP_OUTPUT      0x80      // pinMap entries: ID | IO_MAP_OUTPUT
+
+struct I2CRequest;
+
+typedef struct
+{
+    uint8_t expander;
+    uint8_t pin;
+} DigitalPin;
+
+typedef struct
+{
+    uint32_t interval;      // ms between samples
+    uint32_t due;           // millis() the next sample is due
+    uint32_t publishedAt;   // millis() of the last publish
+    uint16_t filtered;      // value << 8
+    uint8_t  oversample;    // samples per burst
+    uint8_t  emaShift;      // 0 for no smoothing
+    uint8_t  deadband;
+    bool     median;        // median instead of mean of a burst
+    bool     valid;         // filtered holds a value
+} AnalogChannel;
 
 class IOExpansion
 {
   public:
-    void begin(IOChangeDelegate dlg = NULL);
+    void begin();
+    void loadConfig();
+    void rescan();
+    void print(CommandOutput* out);
     bool updateResource(String resource, String value);
     String getResourceValue(String resource);
     bool toggleResourceValue(String resource);
 
   private:
     /* Digital I/O pins */
+    void loadPins(JsonArray &config, const DigitalPin *defaults,
+                  uint8_t numDefaults, bool outputs);
+    void loadAnalogChannels(JsonArray &config);
+    DigitalPin *getDigitalPin(bool output, uint8_t id);
     bool getDigOutput(uint8_t output);
     bool setDigOutput(uint8_t output, bool enable);
     bool toggleDigOutput(uint8_t output);
     bool getDigInput(uint8_t output);
+    bool writeDigOutput(DigitalPin *pPin, bool enable);
+    void notifyDigital(bool output, uint8_t id, bool enabled);
+    void updateDigitalPins(uint8_t expander, uint16_t states, bool notify);
+    void configureExpander(uint8_t expander, bool known);
     void i2cCheckDigitalState();
-    
+    void onDigitalStates(I2CRequest &request);
+#ifdef MCP23017_INT_PIN
+    void i2cCheckDigitalInterrupt();
+    void onDigitalInterrupt(I2CRequest &request);
+#endif
+
     /* Analog I/O pins */
-    void i2cPublishPcfInputs(byte address, bool forcePublish);
+    void onPcfInputs(I2CRequest &request);
+    void filterAnalog(uint8_t channel, const uint8_t *burst, int rounds);
     void i2cCheckAnalogState();
 
   private:
-     
-    IOChangeDelegate  changeDlg;
-
     bool              digitalFound = FALSE;
     bool              analogFound = FALSE;
 
     Timer             i2cCheckDigitalTimer;
     Timer             i2cCheckAnalogTimer;
+#ifdef MCP23017_INT_PIN
+    Timer             i2cDigitalInterruptTimer;
+#endif
+
+    /* Indexed by ID - 1 */
+    DigitalPin       *digitalInputs = NULL;
+    DigitalPin       *digitalOutputs = NULL;
+    uint8_t           numDigitalInputs = 0;
+    uint8_t           numDigitalOutputs = 0;
+
+    /* Per expander pin the ID mapped to it, 0 if none */
+    uint8_t           pinMap[MCP23017_EXPANDERS][16];
 
-    bool              mcp23017Present[7] = { false, false, false, false,
-                                             false, false, false };
+    bool              mcp23017Present[MCP23017_EXPANDERS] =
+                          { false, false, false, false, false, false, false };
+    /* Last read GPIO and shadowed OLAT, port A low byte, port B high */
+    uint16_t          mcp23017States[MCP23017_EXPANDERS] = { 0, 0, 0, 0, 0, 0, 0 };
+    uint16_t          mcp23017Latches[MCP23017_EXPANDERS] = { 0, 0, 0, 0, 0, 0, 0 };
+    uint16_t          mcp23017Outputs[MCP23017_EXPANDERS] = { 0, 0, 0, 0, 0, 0, 0 };
+    uint8_t           mcp23017Reading = 0;    // GPIO read queued, per bit
+    uint8_t           mcp23017Servicing = 0;  // INTF read queued, per bit
 
-    bool              pcf8591Present[8] = { false, false, false, false,
-                                            false, false, false, false };
-    uint8_t           pcf8591Outputs[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
-    uint8_t           pcf8591Inputs[32] = { 0, 0, 0, 0, 0, 0, 0, 0,
-                                            0, 0, 0, 0, 0, 0, 0, 0,
-                                            0, 0, 0, 0, 0, 0, 0, 0,
-                                            0, 0, 0, 0, 0, 0, 0, 0 };
+    bool              pcf8591Present[PCF8591_EXPANDERS] =
+                          { false, false, false, false,
+                            false, false, false, false };
+    uint8_t           pcf8591Outputs[PCF8591_EXPANDERS] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+    uint8_t           pcf8591Reading = 0;     // burst queued, per bit
+    uint32_t          analogDue = 0;          // channels of those bursts
+    uint8_t           pcf8591Bursts[PCF8591_EXPANDERS]
+                                   [1 + 4 * PCF8591_MAX_OVERSAMPLE];
+    AnalogChannel     analogChannels[PCF8591_CHANNELS];
+    uint8_t           pcf8591Inputs[PCF8591_CHANNELS] =
+                          { 0, 0, 0, 0, 0, 0, 0, 0,
+                            0, 0, 0, 0, 0, 0, 0, 0,
+                            0, 0, 0, 0, 0, 0, 0, 0,
+                            0, 0, 0, 0, 0, 0, 0, 0 };
 };
 
 extern IOExpansion Expansion;
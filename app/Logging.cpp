@@ -0,0 +1,125 @@
+#include <user_config.h>
+#include <SmingCore/SmingCore.h>
+#include <SmingCore/Debug.h>
+#include <Logging.h>
+
+LogClass Log;
+
+static const char * const moduleNames[LOG_MODULES] =
+{
+    "gw", "radio", "mqtt", "rules"
+};
+
+static const uint8_t compiledLevels[LOG_MODULES] =
+{
+    LOG_LEVEL_GW, LOG_LEVEL_RADIO, LOG_LEVEL_MQTT, LOG_LEVEL_RULES
+};
+
+static const char * const levelNames[] =
+{
+    "none", "error", "warn", "info", "debug"
+};
+
+LogClass::LogClass()
+{
+    for (int i = 0; i < LOG_MODULES; i++)
+        levels[i] = compiledLevels[i];
+}
+
+void LogClass::defer(uint8_t module, uint8_t level, const char *format,
+                     const char *text, int numArgs, ...)
+{
+    LogRecord &rec = ring[head];
+    va_list ap;
+
+    rec.format = format;
+    rec.time = millis();
+    rec.module = module;
+    rec.level = level;
+    rec.numArgs = numArgs;
+
+    va_start(ap, numArgs);
+    for (int i = 0; i < numArgs; i++)
+        rec.args[i] = va_arg(ap, uint32_t);
+    va_end(ap);
+
+    if (text)
+    {
+        strncpy(rec.text, text, LOG_TEXT_SIZE - 1);
+        rec.text[LOG_TEXT_SIZE - 1] = 0;
+    }
+    else
+    {
+        rec.text[0] = 0;
+    }
+
+    head = (head + 1) % LOG_RING_SIZE;
+    if (count < LOG_RING_SIZE)
+        count++;
+    else
+        dropped++;
+}
+
+/*
+ * Format the deferred records, oldest first. The arguments are passed as
+ * 32 bit words, which on the ESP8266 is what an int or a pointer is. The
+ * copied text goes in right after the integer arguments.
+ */
+void LogClass::print(CommandOutput* out)
+{
+    char line[128];
+    uint32_t a[LOG_RECORD_ARGS + 1];
+
+    if (dropped)
+        out->printf("(%lu older records overwritten)\r\n", dropped);
+
+    for (int n = 0; n < count; n++)
+    {
+        LogRecord &rec = ring[(head + LOG_RING_SIZE - count + n) % LOG_RING_SIZE];
+
+        memset(a, 0, sizeof(a));
+        memcpy(a, rec.args, rec.numArgs * sizeof(uint32_t));
+        a[rec.numArgs] = (uint32_t)rec.text;
+
+        m_snprintf(line, sizeof(line), rec.format,
+                   a[0], a[1], a[2], a[3], a[4], a[5], a[6]);
+        out->printf("%8lu %-5s %s\r\n", rec.time, moduleNames[rec.module],
+                    line);
+    }
+}
+
+void LogClass::clear()
+{
+    count = 0;
+    dropped = 0;
+}
+
+void LogClass::printLevels(CommandOutput* out)
+{
+    for (int i = 0; i < LOG_MODULES; i++)
+        out->printf("%-6s : %s (compiled in up to %s)\r\n", moduleNames[i],
+                    levelNames[levels[i]], levelNames[compiledLevels[i]]);
+}
+
+/* Module "all" sets every module. Levels by name or number. */
+bool LogClass::setLevel(const String &module, const String &levelName)
+{
+    bool found = false;
+    int level = -1;
+
+    for (int i = LOG_NONE; i <= LOG_DEBUG; i++)
+        if (levelName == levelNames[i] || levelName == String(i))
+            level = i;
+    if (level < 0)
+        return false;
+
+    for (int i = 0; i < LOG_MODULES; i++)
+    {
+        if (module == "all" || module == moduleNames[i])
+        {
+            levels[i] = level;
+            found = true;
+        }
+    }
+    return found;
+}
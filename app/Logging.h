@@ -0,0 +1,121 @@
+#ifndef INCLUDE_LOGGING_H_
+#define INCLUDE_LOGGING_H_
+
+#include <user_config.h>
+#include <SmingCore/SmingCore.h>
+#include <SmingCore/Debug.h>
+
+/*
+ * Per module logging. Each module has a compile time level, anything
+ * above it compiles to nothing, arguments included. Below that a runtime
+ * level, changed with the telnet 'log level' command, filters further.
+ *
+ * LOG() formats and prints right away. LOG_DEFER() is meant for the
+ * packet path: it stores the format and up to LOG_RECORD_ARGS integer
+ * arguments in a ring, and the text is only made when the ring is read
+ * with the telnet 'log' command. Its format has to be a literal. With
+ * LOG_DEFER_S() one string can be passed too, it is copied (truncated to
+ * LOG_TEXT_SIZE - 1 chars) and must be the last conversion of the format.
+ * String literals never move, so they may be passed as plain arguments.
+ */
+#define LOG_NONE    0
+#define LOG_ERROR   1
+#define LOG_WARN    2
+#define LOG_INFO    3
+#define LOG_DEBUG   4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL       LOG_DEBUG
+#endif
+#ifndef LOG_LEVEL_GW
+#define LOG_LEVEL_GW    LOG_LEVEL   // MyGateway
+#endif
+#ifndef LOG_LEVEL_RADIO
+#define LOG_LEVEL_RADIO LOG_LEVEL   // MySensors library
+#endif
+#ifndef LOG_LEVEL_MQTT
+#define LOG_LEVEL_MQTT  LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_RULES
+#define LOG_LEVEL_RULES LOG_LEVEL
+#endif
+
+#ifndef LOG_RING_SIZE
+#define LOG_RING_SIZE   32          // deferred records kept
+#endif
+#define LOG_RECORD_ARGS 6
+#define LOG_TEXT_SIZE   12
+
+enum LogModule
+{
+    LOG_MODULE_GW,
+    LOG_MODULE_RADIO,
+    LOG_MODULE_MQTT,
+    LOG_MODULE_RULES,
+    LOG_MODULES
+};
+
+typedef struct
+{
+    const char *format;     // a literal, so the pointer is the format ID
+    uint32_t    time;       // millis()
+    uint8_t     module;
+    uint8_t     level;
+    uint8_t     numArgs;
+    char        text[LOG_TEXT_SIZE];
+    uint32_t    args[LOG_RECORD_ARGS];
+} LogRecord;
+
+class LogClass
+{
+  public:
+    LogClass();
+
+    void defer(uint8_t module, uint8_t level, const char *format,
+               const char *text, int numArgs, ...);
+    void print(CommandOutput* out);
+    void clear();
+    void printLevels(CommandOutput* out);
+    bool setLevel(const String &module, const String &level);
+
+  public:
+    uint8_t   levels[LOG_MODULES]; // runtime levels
+
+  private:
+    LogRecord ring[LOG_RING_SIZE];
+    uint16_t  head = 0;            // next record to write
+    uint16_t  count = 0;
+    uint32_t  dropped = 0;         // overwritten before being read
+};
+
+extern LogClass Log;
+
+#define LOG_ENABLED(module, level) \
+    ((level) <= LOG_LEVEL_##module && \
+     (level) <= Log.levels[LOG_MODULE_##module])
+
+/* Number of arguments, 0 to LOG_RECORD_ARGS */
+#define LOG_NARGS(...) LOG_NARGS_(0, ##__VA_ARGS__, 6, 5, 4, 3, 2, 1, 0)
+#define LOG_NARGS_(_0, _1, _2, _3, _4, _5, _6, N, ...) N
+
+#define LOG(module, level, format, ...) \
+    do { \
+        if (LOG_ENABLED(module, level)) \
+            Debug.printf(format "\n", ##__VA_ARGS__); \
+    } while (0)
+
+#define LOG_DEFER(module, level, format, ...) \
+    do { \
+        if (LOG_ENABLED(module, level)) \
+            Log.defer(LOG_MODULE_##module, level, format, NULL, \
+                      LOG_NARGS(__VA_ARGS__), ##__VA_ARGS__); \
+    } while (0)
+
+#define LOG_DEFER_S(module, level, text, format, ...) \
+    do { \
+        if (LOG_ENABLED(module, level)) \
+            Log.defer(LOG_MODULE_##module, level, format, text, \
+                      LOG_NARGS(__VA_ARGS__), ##__VA_ARGS__); \
+    } while (0)
+
+#endif //INCLUDE_LOGGING_H_
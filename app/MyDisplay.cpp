@@ -5,9 +5,11 @@
 
 #include <AppSettings.h>
 #include "MyDisplay.h"
+#include "i2c.h"
 #include "mqtt.h"
 #include "Network.h"
 #include "AppSettings.h"
+#include "MyGateway.h"
 
 MyDisplay Display;
 
@@ -20,9 +22,15 @@ Adafruit_SSD1306 display(-1); // reset Pin required but later ignored if set to
 LiquidCrystal_I2C lcd(I2C_LCD_ADDR, 2, 1, 0, 4, 5, 6, 7, 3, POSITIVE);
 #endif
 
+/*
+ * The OLED is drawn in RAM here, only sending it out is queued on the
+ * I2C bus. Every character written to the LCD goes over the bus, so all
+ * of that is queued.
+ */
 void MyDisplay::update()
 {
-    Wire.lock();
+    if (refreshQueued)
+        return;
 
 #if DISPLAY_TYPE == DISPLAY_TYPE_SSD1306
     display.clearDisplay();
@@ -82,9 +90,38 @@ void MyDisplay::update()
     display.println(system_get_free_heap_size());
 
     display.setTextColor(WHITE);
+    display.setCursor(0,45);
+    display.println(lastChange.c_str());
 
     //display.setTextColor(BLACK, WHITE); // 'inverted' text
     //display.setTextSize(3);
+
+    refreshQueued = I2CBus.submitJob(SSD1306_I2C_ADDRESS, I2C_PRIO_DISPLAY,
+                                     I2CJobDelegate(&MyDisplay::refresh, this));
+#elif DISPLAY_TYPE == DISPLAY_TYPE_20X4
+    refreshQueued = I2CBus.submitJob(I2C_LCD_ADDR, I2C_PRIO_DISPLAY,
+                                     I2CJobDelegate(&MyDisplay::refresh, this));
+#endif
+}
+
+/* Shown on the next update, the OLED has a line left for it */
+void MyDisplay::onEvent(const Event &event)
+{
+    if (event.topic == EVENT_IO)
+    {
+        lastChange = event.io.getName() + "=" + event.io.getValue();
+    }
+    else if (event.sensor.changed)
+    {
+        lastChange = event.sensor.getName() + "=" + event.sensor.value;
+    }
+}
+
+void MyDisplay::refresh()
+{
+    refreshQueued = false;
+
+#if DISPLAY_TYPE == DISPLAY_TYPE_SSD1306
     display.display();
 #elif DISPLAY_TYPE == DISPLAY_TYPE_20X4
     lcd.setCursor(0, 0);
@@ -106,8 +143,6 @@ void MyDisplay::update()
     for (int i=0; i<20-6-ip.length(); i++)
         lcd.print(" ");
 #endif
-
-    Wire.unlock();
 }
 
 void MyDisplay::begin()
@@ -157,5 +192,10 @@ void MyDisplay::begin()
     if (displayFound)
     {
         displayTimer.initializeMs(1000, TimerDelegate(&MyDisplay::update, this)).start(true);
+#if DISPLAY_TYPE == DISPLAY_TYPE_SSD1306
+        Events.subscribe(EVENT_TOPIC_MASK(EVENT_IO) |
+                         EVENT_TOPIC_MASK(EVENT_SENSOR),
+                         EventDelegate(&MyDisplay::onEvent, this));
+#endif
     }
 }
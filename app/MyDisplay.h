@@ -5,6 +5,7 @@
 #include <SmingCore/SmingCore.h>
 #include <SmingCore/Debug.h>
 #include <AppSettings.h>
+#include <Event.h>
 
 class MyDisplay
 {
@@ -13,9 +14,13 @@ class MyDisplay
 
   private:
     void  update();
+    void  refresh();
+    void  onEvent(const Event &event);
 
   private:
     bool  displayFound = FALSE;
+    bool  refreshQueued = FALSE;
+    String lastChange;      // "<object>=<value>" of the last event
 
     Timer displayTimer;
 };
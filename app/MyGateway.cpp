@@ -4,9 +4,15 @@
 #include "MyGateway.h"
 #include "MySensors/MySigningAtsha204.h"
 #include "MySensors/MySigningAtsha204Soft.h"
-#include "Rule.h"
+#include "Event.h"
 #include "HTTP.h"
 #include "MyStatus.h"
+#include "SensorStats.h"
+#include "Logging.h"
+#include "Perf.h"
+#if SIGNING_ENABLE && ATSHA204I2C
+#include "i2c.h"
+#endif
 
 //#define RADIO_CE_PIN 2
 //#define RADIO_SPI_SS_PIN 15
@@ -15,7 +21,39 @@ MyTransportNRF24 transport(RADIO_CE_PIN, RADIO_SPI_SS_PIN, RF24_PA_LEVEL_GW);
 MyHwESP8266 hw;
 #if SIGNING_ENABLE
 #if ATSHA204I2C 
-MySigningAtsha204 signer(true /* requestSignatures */);
+#define ATSHA204_I2C_ADDRESS 0x64
+
+/*
+ * Signing runs synchronously from the radio path, outside the I2C queue.
+ * Account the calls that talk to the ATSHA204 as its bus time all the
+ * same, so 'i2c' shows what signing costs the other devices.
+ */
+class MyAccountedSigningAtsha204 : public MySigningAtsha204
+{
+  public:
+    MyAccountedSigningAtsha204(bool requestSignatures)
+        : MySigningAtsha204(requestSignatures) {}
+
+    bool getNonce(MyMessage &msg)
+    {
+        I2CBusTime busTime(ATSHA204_I2C_ADDRESS);
+        return MySigningAtsha204::getNonce(msg);
+    }
+
+    bool signMsg(MyMessage &msg)
+    {
+        I2CBusTime busTime(ATSHA204_I2C_ADDRESS);
+        return MySigningAtsha204::signMsg(msg);
+    }
+
+    bool verifyMsg(MyMessage &msg)
+    {
+        I2CBusTime busTime(ATSHA204_I2C_ADDRESS);
+        return MySigningAtsha204::verifyMsg(msg);
+    }
+};
+
+MyAccountedSigningAtsha204 signer(true /* requestSignatures */);
 #else
 uint8_t HMAC_KEY[32] = SIGNING_HMAC;
 MySigningAtsha204Soft signer(true /* requestSignatures */,
@@ -41,7 +79,18 @@ MyGateway::MyGateway() : gw(transport,
         nodeIds[i] = false;
     
     for (int i = 0; i < MAX_MY_SENSORS; i++)
-        memset(&mySensors[i], 0, sizeof(sensor_t));
+        clearSensor(i);
+}
+
+void MyGateway::clearSensor(int index)
+{
+    mySensors[index].node = 0;
+    mySensors[index].sensor = 0;
+    mySensors[index].type = 0;
+    mySensors[index].value = "";
+    mySensors[index].topicType = 0;
+    mySensors[index].topic = "";
+    SensorStats.clear(index);
 }
 
 void MyGateway::process()
@@ -54,37 +103,107 @@ const char * MyGateway::version()
    return(LIBRARY_VERSION);
 }
 
+/* An entry of the sensor table as it is now */
+void MyGateway::getSensorEvent(int index, SensorEvent &sensor)
+{
+    sensor.index = index;
+    sensor.node = mySensors[index].node;
+    sensor.sensor = mySensors[index].sensor;
+    sensor.type = mySensors[index].type;
+    sensor.set = false;
+    sensor.changed = false;
+    strncpy(sensor.value, mySensors[index].value.c_str(),
+            sizeof(sensor.value) - 1);
+    sensor.value[sizeof(sensor.value) - 1] = '\0';
+}
+
+void MyGateway::publishSensor(int index, bool set, bool changed)
+{
+    Event event;
+
+    event.topic = EVENT_SENSOR;
+    getSensorEvent(index, event.sensor);
+    event.sensor.set = set;
+    event.sensor.changed = changed;
+    Events.publish(event);
+}
+
 String MyGateway::getSensorJson(int index)
+{
+    SensorEvent sensor;
+
+    getSensorEvent(index, sensor);
+    return getSensorJson(sensor);
+}
+
+String MyGateway::getSensorJson(const SensorEvent &sensor)
 {
     String sensorStr = String("{\"type\": \"sensor\", \"data\" : ") +
-                       String("{\"id\": ") + String(index+1) +
+                       String("{\"id\": ") + String(sensor.index+1) +
                        String(",\"node\": ") +
-                       String(mySensors[index].node) +
+                       String(sensor.node) +
                        String(",\"sensor\": ") +
-                       String(mySensors[index].sensor) +
+                       String(sensor.sensor) +
                        String(",\"type\": ") +
-                       String(mySensors[index].type) +
+                       String(sensor.type) +
                        String(",\"value\": \"");
-    if (!mySensors[index].value.equals(""))
-        sensorStr += String(mySensors[index].value);
+    sensorStr += sensor.value;
     sensorStr += String("\"}}");
 
     return sensorStr;
 }
 
+/*
+ * Radio packets seen by the MySensors library, as deferred log records.
+ * The payload text is only formatted when the radio log level is on.
+ */
+void myPacketHook(uint8_t event, const MyMessage &message, uint8_t to, bool ok)
+{
+    char payload[MAX_PAYLOAD * 2 + 1];
+
+    switch (event)
+    {
+        case MY_PACKET_SENT:
+            LOG_DEFER_S(RADIO, LOG_DEBUG, message.getString(payload),
+                        "send: %d-%d s=%d,c=%d,t=%d,st=%s:%s",
+                        to, message.destination, message.sensor,
+                        mGetCommand(message), message.type,
+                        to == BROADCAST_ADDRESS ? "bc" : (ok ? "ok" : "fail"));
+            break;
+        case MY_PACKET_READ:
+            LOG_DEFER_S(RADIO, LOG_DEBUG, GW.getPayloadString(message),
+                        "read: %d-%d-%d s=%d,c=%d,t=%d:%s",
+                        message.sender, message.last, message.destination,
+                        message.sensor, mGetCommand(message), message.type);
+            break;
+        case MY_PACKET_FORWARD:
+            LOG_DEFER_S(RADIO, LOG_DEBUG, GW.getPayloadString(message),
+                        "read and forward: %d-%d-%d s=%d,c=%d,t=%d:%s",
+                        message.sender, message.last, message.destination,
+                        message.sensor, mGetCommand(message), message.type);
+            break;
+        case MY_PACKET_DROP:
+            LOG_DEFER_S(RADIO, LOG_DEBUG, GW.getPayloadString(message),
+                        "read and drop: %d-%d-%d s=%d,c=%d,t=%d:%s",
+                        message.sender, message.last, message.destination,
+                        message.sensor, mGetCommand(message), message.type);
+            break;
+    }
+}
+
 void MyGateway::incomingMessage(const MyMessage &message)
 {
+    PERF_SCOPE(PERF_INCOMING);
     msg = message;
 
     #if MEASURE_ENABLE
     digitalWrite(SCOPE_PIN, true);
     #endif
 
-    // Pass along the message from sensors to serial line
-    Debug.printf("RX %d;%d;%d;%d;%d;%s\n",
-                 message.sender, message.sensor,
-                 mGetCommand(message), mGetAck(message),
-                 message.type, message.getString(convBuf));
+    LOG_DEFER_S(GW, LOG_DEBUG, getPayloadString(message),
+                "RX %d;%d;%d;%d;%d;%s",
+                message.sender, message.sensor,
+                mGetCommand(message), mGetAck(message), message.type);
 
     if (!msg.isAck())
     {
@@ -96,7 +215,7 @@ void MyGateway::incomingMessage(const MyMessage &message)
         {
             numDetectedNodes++;
             getStatusObj().updateDetectedSensors(1,0);
-            Debug.printf("Discovered new node %d\n", msg.sender);
+            LOG(GW, LOG_INFO, "Discovered new node %d", msg.sender);
             nodeIds[(uint8_t)msg.sender] = true;
         }
 
@@ -114,7 +233,7 @@ void MyGateway::incomingMessage(const MyMessage &message)
                 {
                     if (nodeIds[id] == false)
                     {
-                        Debug.printf("Found id %d for new node\n", id);
+                        LOG(GW, LOG_INFO, "Found id %d for new node", id);
                         gw.sendRoute(build(msg, msg.sender, 255,
                                            C_INTERNAL, I_ID_RESPONSE,
                                            0).set((uint8_t)id));
@@ -139,22 +258,20 @@ void MyGateway::incomingMessage(const MyMessage &message)
                     mySensors[idx].sensor == message.sensor)
                 {
                     mySensors[idx].type = message.type;
+                    bool changed = false;
                     if (mGetCommand(msg) == C_SET)
                     {
-                        String newValue = message.getString(convBuf);
-                        if (sensorValueChanged &&
-                            !newValue.equals(mySensors[idx].value))
-                        {
-                            sensorValueChanged(idx, newValue);
-                        }
+                        String newValue = getPayloadString(message);
+                        changed = !newValue.equals(mySensors[idx].value);
                         mySensors[idx].value = newValue;
-                        Debug.printf("Updating sensor %d (%d/%d) type %d value %s\n",
-                                     idx, mySensors[idx].node, mySensors[idx].sensor,
-                                     mySensors[idx].type, mySensors[idx].value.c_str());
-                        Rules.processTrigger("sensor"+String(idx+1));
+                        SensorStats.add(idx, newValue);
+                        LOG_DEFER_S(GW, LOG_DEBUG, mySensors[idx].value.c_str(),
+                                    "Updating sensor %d (%d/%d) type %d value %s",
+                                    idx, mySensors[idx].node, mySensors[idx].sensor,
+                                    mySensors[idx].type);
                     }
                     newSensor = false;
-                    HTTP.notifyWsClients(getSensorJson(idx));
+                    publishSensor(idx, mGetCommand(msg) == C_SET, changed);
                     break;
                 }
             }
@@ -169,28 +286,22 @@ void MyGateway::incomingMessage(const MyMessage &message)
                         mySensors[idx].node = message.sender;
                         mySensors[idx].sensor = message.sensor;
                         mySensors[idx].type = message.type;
+                        bool changed = false;
                         if (mGetCommand(msg) == C_SET)
                         {
-                            String newValue = message.getString(convBuf);
-                            if (sensorValueChanged &&
-                                !newValue.equals(mySensors[idx].value))
-                            {
-                                sensorValueChanged(idx, newValue);
-                            }
+                            String newValue = getPayloadString(message);
+                            changed = !newValue.equals(mySensors[idx].value);
                             mySensors[idx].value = newValue;
-                            HTTP.notifyWsClients(getSensorJson(idx));
-                            Rules.processTrigger("sensor"+String(idx+1));
+                            SensorStats.add(idx, newValue);
                         }
-                        else
-                        {
-                            HTTP.notifyWsClients(getSensorJson(idx));
-                        }                            
+                        publishSensor(idx, mGetCommand(msg) == C_SET,
+                                      changed);
                         numDetectedSensors++;
                         getStatusObj().updateDetectedSensors(0,1);
 
-                        Debug.printf("Adding sensor %d (%d/%d) type %d value %s\n",
-                                     idx, mySensors[idx].node, mySensors[idx].sensor,
-                                     mySensors[idx].type, mySensors[idx].value.c_str());
+                        LOG(GW, LOG_INFO, "Adding sensor %d (%d/%d) type %d value %s",
+                            idx, mySensors[idx].node, mySensors[idx].sensor,
+                            mySensors[idx].type, mySensors[idx].value.c_str());
                         newSensor = false;
 
                         DynamicJsonBuffer jsonBuffer;
@@ -215,9 +326,9 @@ void MyGateway::incomingMessage(const MyMessage &message)
 
             if (newSensor)
             {
-                Debug.printf("No entry left for new sensor %d/%d type %d value %s\n",
-                             message.sender, message.sensor,
-                             message.type, message.getString(convBuf));
+                LOG(GW, LOG_WARN, "No entry left for new sensor %d/%d type %d value %s",
+                    message.sender, message.sensor,
+                    message.type, getPayloadString(message));
                 return;
             }
         }
@@ -227,8 +338,7 @@ void MyGateway::incomingMessage(const MyMessage &message)
                 msg.type=msg.type+(S_FIRSTCUSTOM-10); //Special message
         }
 
-        if (msgRx)
-            msgRx(message);
+        Events.publishMessage(message);
 
     #if MEASURE_ENABLE
     digitalWrite(SCOPE_PIN, false);
@@ -237,10 +347,8 @@ void MyGateway::incomingMessage(const MyMessage &message)
     }
 }
 
-void MyGateway::begin(msgRxDelegate rxDlg, sensorValueChangedDelegate valueChanged)
+void MyGateway::begin()
 {
-    msgRx = rxDlg;
-    sensorValueChanged = valueChanged;
     numDetectedNodes = 0;
     numDetectedSensors = 0;
 
@@ -406,7 +514,7 @@ void MyGateway::onWsRemoveSensor(WebSocket& socket, const String& message)
             mySensors[idx].sensor == sensor)
         {
             Debug.printf("Removing sensor %d %d.\n", node, sensor);
-            memset(&mySensors[idx], 0, sizeof(sensor_t));
+            clearSensor(idx);
             return;
         }
     }
@@ -437,7 +545,7 @@ void MyGateway::onRemoveSensor(HttpRequest &request, HttpResponse &response)
             if (strcmp(romToRemove.c_str(), rom) == 0)
             {
                 Debug.printf("Removing sensor %d with rom %s.\n", i, rom);
-                memset(&mySensors[i], 0, sizeof(sensor_t));
+                clearSensor(i);
                 break;
             }
         }
@@ -475,198 +583,117 @@ void MyGateway::registerHttpHandlers(HttpServer &server)
     HTTP.addWsCommand("setActuator", WebSocketMessageDelegate(&MyGateway::onWsSetActuator, this));
     HTTP.addWsCommand("removeSensor", WebSocketMessageDelegate(&MyGateway::onWsRemoveSensor, this));
     HTTP.addWsCommand("getStatus", WebSocketMessageDelegate(&MyGateway::onWsGetStatus, this));
+
+    SensorStats.registerHttpHandlers(server);
 }
 
+#define SENSOR_TYPE_HASH_SEED  0x2b96
+#define SENSOR_TYPE_HASH_SLOTS 128
+
+static const char * const sensorTypeNames[64] =
+{
+    "TEMP", "HUM", "LIGHT", "DIMMER", "PRESSURE", "FORECAST", "RAIN",
+    "RAINRATE", "WIND", "GUST", "DIRECTON", "UV", "WEIGHT", "DISTANCE",
+    "IMPEDANCE", "ARMED", "TRIPPED", "WATT", "KWH", "SCENE_ON",
+    "SCENE_OFF", "HEATER", "HEATER_SW", "LIGHT_LEVEL", "VAR1", "VAR2",
+    "VAR3", "VAR4", "VAR5", "UP", "DOWN", "STOP", "IR_SEND", "IR_RECEIVE",
+    "FLOW", "VOLUME", "LOCK_STATUS", "DUST_LEVEL", "VOLTAGE", "CURRENT",
+    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+    "DEFAULT", "SKETCH_NAME", "SKETCH_VERSION", "UNKNOWN"
+};
+
+/*
+ * Perfect hash of the names above: every name lands in its own slot, so
+ * a lookup is one hash and one string compare. Regenerate the table and
+ * seed when a type is added.
+ */
+static const uint8_t sensorTypeHashSlots[SENSOR_TYPE_HASH_SLOTS] =
+{
+    255, 255,   5, 255, 255, 255,  16, 255,
+    255, 255, 255, 255,  62,  32, 255,  11,
+    255, 255, 255,  22, 255, 255, 255,  31,
+    255, 255, 255, 255,  39,   4, 255, 255,
+     61,  12, 255,  34, 255, 255,  14, 255,
+    255, 255, 255, 255,  33, 255, 255, 255,
+     60, 255,  36,   2, 255,  24,  18, 255,
+    255, 255, 255, 255, 255, 255, 255, 255,
+     25, 255, 255,   7, 255, 255, 255,   6,
+    255, 255, 255, 255, 255, 255,  35, 255,
+    255, 255,  20,  26, 255,   0,  27, 255,
+    255, 255, 255, 255,  63, 255, 255,   9,
+     30,  28,   1,   3, 255, 255,  17,  10,
+    255,  19, 255, 255, 255,  23, 255, 255,
+    255, 255, 255,  21, 255,  37,  38, 255,
+    255,  29, 255,  13,  15, 255, 255,   8,
+};
+
 String MyGateway::getSensorTypeString(int type)
 {
-    switch (type)
+    if (type < 0 || type >= 64 || sensorTypeNames[type] == NULL)
+        return "";
+    return sensorTypeNames[type];
+}
+
+/*
+ * Returns the "<node>/<sensor>/V_<TYPE>" topic for a message. Topics of
+ * registered sensors are rendered once and kept in the registry.
+ */
+const String& MyGateway::getSensorTopic(const MyMessage &message)
+{
+    for (int idx = 0; idx < MAX_MY_SENSORS; idx++)
     {
-        case 0:
-            return "TEMP";
-        case 1:
-            return "HUM";
-        case 2:
-            return "LIGHT";
-        case 3:
-            return "DIMMER";
-        case 4:
-            return "PRESSURE";
-        case 5:
-            return "FORECAST";
-        case 6:
-            return "RAIN";
-        case 7:
-            return "RAINRATE";
-        case 8:
-            return "WIND";
-        case 9:
-            return "GUST";
-        case 10:
-            return "DIRECTON";
-        case 11:
-            return "UV";
-        case 12:
-            return "WEIGHT";
-        case 13:
-            return "DISTANCE";
-        case 14:
-            return "IMPEDANCE";
-        case 15:
-            return "ARMED";
-        case 16:
-            return "TRIPPED";
-        case 17:
-            return "WATT";
-        case 18:
-            return "KWH";
-        case 19:
-            return "SCENE_ON";
-        case 20:
-            return "SCENE_OFF";
-        case 21:
-            return "HEATER";
-        case 22:
-            return "HEATER_SW";
-        case 23:
-            return "LIGHT_LEVEL";
-        case 24:
-            return "VAR1";
-        case 25:
-            return "VAR2";
-        case 26:
-            return "VAR3";
-        case 27:
-            return "VAR4";
-        case 28:
-            return "VAR5";
-        case 29:
-            return "UP";
-        case 30:
-            return "DOWN";
-        case 31:
-            return "STOP";
-        case 32:
-            return "IR_SEND";
-        case 33:
-            return "IR_RECEIVE";
-        case 34:
-            return "FLOW";
-        case 35:
-            return "VOLUME";
-        case 36:
-            return "LOCK_STATUS";
-        case 37:
-            return "DUST_LEVEL";
-        case 38:
-            return "VOLTAGE";
-        case 39:
-            return "CURRENT";
-        case 60:
-            return "DEFAULT";
-        case 61:
-            return "SKETCH_NAME";
-        case 62:
-            return "SKETCH_VERSION";
-        case 63:
-            return "UNKNOWN";
-
-        default:
-            return "";
+        sensor_t *s = &mySensors[idx];
+        if (s->node != message.sender || s->sensor != message.sensor)
+            continue;
+
+        if (s->topic.length() == 0 || s->topicType != message.type)
+        {
+            s->topicType = message.type;
+            s->topic = String(message.sender) + "/" +
+                       String(message.sensor) + "/V_" +
+                       getSensorTypeString(message.type);
+        }
+        return s->topic;
     }
+
+    unregisteredTopic = String(message.sender) + "/" +
+                        String(message.sensor) + "/V_" +
+                        getSensorTypeString(message.type);
+    return unregisteredTopic;
+}
+
+int MyGateway::getSensorTypeFromString(const char *type, int len)
+{
+    uint32_t hash = SENSOR_TYPE_HASH_SEED;
+
+    for (int i = 0; i < len; i++)
+        hash = (hash ^ (uint8_t)type[i]) * 16777619;
+    hash = (hash ^ (hash >> 16)) % SENSOR_TYPE_HASH_SLOTS;
+
+    uint8_t candidate = sensorTypeHashSlots[hash];
+    if (candidate == 255 ||
+        strncmp(sensorTypeNames[candidate], type, len) != 0 ||
+        sensorTypeNames[candidate][len] != 0)
+        return 255;
+
+    return candidate;
 }
 
 int MyGateway::getSensorTypeFromString(String type)
 {
-    if (type == "TEMP")
-        return 0;
-    if (type == "HUM")
-        return 1;
-    if (type == "LIGHT")
-        return 2;
-    if (type == "DIMMER")
-        return 3;
-    if (type == "PRESSURE")
-        return 4;
-    if (type == "FORECAST")
-        return 5;
-    if (type == "RAIN")
-        return 6;
-    if (type == "RAINRATE")
-        return 7;
-    if (type == "WIND")
-        return 8;
-    if (type == "GUST")
-        return 9;
-    if (type == "DIRECTON")
-        return 10;
-    if (type == "UV")
-        return 11;
-    if (type == "WEIGHT")
-        return 12;
-    if (type == "DISTANCE")
-        return 13;
-    if (type == "IMPEDANCE")
-        return 14;
-    if (type == "ARMED")
-        return 15;
-    if (type == "TRIPPED")
-        return 16;
-    if (type == "WATT")
-        return 17;
-    if (type == "KWH")
-        return 18;
-    if (type == "SCENE_ON")
-        return 19;
-    if (type == "SCENE_OFF")
-        return 20;
-    if (type == "HEATER")
-        return 21;
-    if (type == "HEATER_SW")
-        return 22;
-    if (type == "LIGHT_LEVEL")
-        return 23;
-    if (type == "VAR1")
-        return 24;
-    if (type == "VAR2")
-        return 25;
-    if (type == "VAR3")
-        return 26;
-    if (type == "VAR4")
-        return 27;
-    if (type == "VAR5")
-        return 28;
-    if (type == "UP")
-        return 29;
-    if (type == "DOWN")
-        return 30;
-    if (type == "STOP")
-        return 31;
-    if (type == "IR_SEND")
-        return 32;
-    if (type == "IR_RECEIVE")
-        return 33;
-    if (type == "FLOW")
-        return 34;
-    if (type == "VOLUME")
-        return 35;
-    if (type == "LOCK_STATUS")
-        return 36;
-    if (type == "DUST_LEVEL")
-        return 37;
-    if (type == "VOLTAGE")
-        return 38;
-    if (type == "CURRENT")
-        return 39;
-    if (type == "DEFAULT")
-        return 60;
-    if (type == "SKETCH_NAME")
-        return 61;
-    if (type == "SKETCH_VERSION")
-        return 62;
-    if (type == "UNKNOWN")
-        return 63;
-
-    return 255;
+    return getSensorTypeFromString(type.c_str(), type.length());
+}
+
+int MyGateway::getSensorIndex(uint8_t node, uint8_t sensor)
+{
+    if (node == 0)
+        return -1; // free slots look like node 0
+
+    for (int idx = 0; idx < MAX_MY_SENSORS; idx++)
+        if (mySensors[idx].node == node && mySensors[idx].sensor == sensor)
+            return idx;
+    return -1;
 }
 
 String MyGateway::getSensorValue(String object)
@@ -694,6 +721,12 @@ void MyGateway::setSensorValue(String object, String value)
     getStatusObj().updateRfPackets (0, 1);
 }
 
+/* Text of a payload, formatted once per received message */
+const char *MyGateway::getPayloadString(const MyMessage &message)
+{
+    return gw.getPayloadString(message);
+}
+
 uint64_t MyGateway::getBaseAddress()
 {
     return rfBaseAddress;
@@ -44,19 +44,21 @@ typedef struct sensor
     uint8_t sensor;
     uint8_t type;
     String value;
+    uint8_t topicType;  // value type the cached topic was rendered for
+    String topic;       // cached "<node>/<sensor>/V_<TYPE>" topic
 } sensor_t;
 #define MAX_MY_SENSORS 32
 
 typedef Delegate<void(const MyMessage &)> msgRxDelegate;
-typedef Delegate<void(int sensorId, String value)> sensorValueChangedDelegate;
+
+struct SensorEvent;
 
 class MyGateway
 {
   public:
     MyGateway();
 
-    void begin(msgRxDelegate = NULL,
-               sensorValueChangedDelegate valueChanged = NULL);
+    void begin();
     const char * version();
     boolean sendRoute(MyMessage &msg);
     MyMessage& build (MyMessage &msg, uint8_t destination,
@@ -65,6 +67,12 @@ class MyGateway
     void registerHttpHandlers(HttpServer &server);
     static String getSensorTypeString(int type);
     static int getSensorTypeFromString(String type);
+    static int getSensorTypeFromString(const char *type, int len);
+    const String& getSensorTopic(const MyMessage &message);
+    const char *getPayloadString(const MyMessage &message);
+    String getSensorJson(int index);
+    static String getSensorJson(const SensorEvent &sensor);
+    int getSensorIndex(uint8_t node, uint8_t sensor);
     String getSensorValue(String object);
     void setSensorValue(String object, String value);
     uint64_t getBaseAddress();
@@ -82,14 +90,13 @@ class MyGateway
                       HttpResponse &response);
     void onRemoveSensor(HttpRequest &request,
                         HttpResponse &response);
-    String getSensorJson(int index);
+    void clearSensor(int index);
+    void getSensorEvent(int index, SensorEvent &sensor);
+    void publishSensor(int index, bool set, bool changed);
     void onWsGetStatus (WebSocket& socket, const String& message);
 
   private:
     uint64_t rfBaseAddress;
-    char convBuf[MAX_PAYLOAD*2+1];
-    msgRxDelegate msgRx;
-    sensorValueChangedDelegate sensorValueChanged;
     MySensor gw;
     Timer processTimer;
     bool nodeIds[256];
@@ -97,6 +104,7 @@ class MyGateway
     uint8_t numDetectedNodes;
     uint16_t numDetectedSensors;
     MyMessage msg;
+    String unregisteredTopic;
 };
 
 extern MyGateway GW;
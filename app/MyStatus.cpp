@@ -17,6 +17,8 @@ MyStatus::MyStatus()
     freeHeapSize = 0;
     numDetectedNodes = 0;
     numDetectedSensors = 0;
+    statusPublished = false;
+    firmwarePublished = false;
     //numRfPktRx = 0;
     //numRfPktTx = 0;
     //numMqttPktRx = 0;
@@ -28,6 +30,14 @@ void MyStatus::begin()
   started = 1;
 	updateTimer.initializeMs(2000,
 			TimerDelegate(&MyStatus::notifyCounters, this));
+  Events.subscribe(EVENT_TOPIC_MASK(EVENT_SYSTEM),
+                   EventDelegate(&MyStatus::onEvent, this));
+}
+
+void MyStatus::onEvent(const Event &event)
+{
+    if (event.system.kind == SYSTEM_FREE_HEAP)
+        updateFreeHeapSize(event.system.value);
 }
 
 void MyStatus::registerHttpHandlers(HttpServer &server)
@@ -54,14 +64,20 @@ String MyStatus::makeJsonEnd()
     return str;
 }
 
+/*
+ * Status updates are collected and announced on the event bus, HTTP
+ * takes them all as one WebSocket message when it gets the event. When
+ * the bus was full the next update announces them again.
+ */
 void MyStatus::notifyUpdate(const String& statusStr)
 {
   if (started && !isFirmwareDld)
   {
-    String str = makeJsonStart();
-    str += statusStr;
-    str += makeJsonEnd();
-    HTTP.notifyWsClients(str);
+    if (pendingStatus.length() > 0)
+      pendingStatus += String(",");
+    pendingStatus += statusStr;
+    if (!statusPublished)
+      statusPublished = Events.publishSystem(SYSTEM_STATUS);
   }
   else
   {
@@ -73,19 +89,29 @@ void MyStatus::notifyUpdate(const String& statusStr)
 
 void MyStatus::notifyKeyValue(const String& key, const String& value)
 {
-  if (started && !isFirmwareDld)
-  {
+  notifyUpdate (makeJsonKV (key, value));
+}
+
+String MyStatus::takeStatusUpdate()
+{
+    statusPublished = false;
+    if (pendingStatus.length() == 0)
+      return "";
+
     String str = makeJsonStart();
-    str += makeJsonKV (key, value);
+    str += pendingStatus;
     str += makeJsonEnd();
-    HTTP.notifyWsClients(str);
-  }
-  else
-  {
-    String info = String ("No update because started=") + String (started)
-        + String (" isFirmwareDld=") + String (isFirmwareDld);
-    Debug.println(info);
-  }
+    pendingStatus = "";
+    return str;
+}
+
+String MyStatus::takeFirmwareUpdate()
+{
+    String str = pendingFirmware;
+
+    firmwarePublished = false;
+    pendingFirmware = "";
+    return str;
 }
 
 void MyStatus::onWsGetDldStatus (WebSocket& socket, const String& message)
@@ -186,6 +212,8 @@ void MyStatus::onWsGetStatus (WebSocket& socket, const String& message)
     statusStr += makeJsonKV ("mqttRx", String(mqttPktRx));
     statusStr += String(",");
     statusStr += makeJsonKV ("mqttTx", String(mqttPktTx));
+    statusStr += String(",");
+    statusStr += makeJsonKV ("mqttDropped", String(mqttPktDropped));
     statusStr += makeJsonEnd();
     socket.sendString(statusStr);
 
@@ -289,7 +317,9 @@ void MyStatus::setFirmwareDldStart (int trial)
     str += String("\"value\": \"Firmware download started, trial=") + String(trial)+ String("\"}");
     str += String("]}");
     Debug.println(str.c_str());
-    HTTP.notifyWsClients(str);
+    pendingFirmware = str;
+    if (!firmwarePublished)
+      firmwarePublished = Events.publishSystem(SYSTEM_FIRMWARE, trial);
 }
 
 void MyStatus::setFirmwareDldEnd (bool isSuccess, int trial)
@@ -305,7 +335,9 @@ void MyStatus::setFirmwareDldEnd (bool isSuccess, int trial)
     
     str += String("]}");
     Debug.println(str.c_str());
-    HTTP.notifyWsClients(str);
+    pendingFirmware = str;
+    if (!firmwarePublished)
+      firmwarePublished = Events.publishSystem(SYSTEM_FIRMWARE, trial);
 }
 
 
@@ -8,6 +8,7 @@
 
 #include "MySensors/MyConfig.h"
 #include "MySensors/MySensor.h"
+#include "Event.h"
 
 
 class MyStatus
@@ -30,6 +31,9 @@ class MyStatus
     void setFirmwareDldEnd (bool isSuccess, int trial);
 
     void notifyCounters();
+
+    String takeStatusUpdate();
+    String takeFirmwareUpdate();
     
   protected:
     String makeJsonKV(const String& key, const String& value);
@@ -37,6 +41,7 @@ class MyStatus
     String makeJsonEnd();
     void notifyUpdate(const String& statusStr);
     void notifyKeyValue(const String& key, const String& value);
+    void onEvent(const Event &event);
 
   private:
     int started;
@@ -52,6 +57,12 @@ class MyStatus
     //uint32 numMqttPktTx;
     
     uint32 freeHeapSize;
+
+    // Waiting for the WebSocket push, see takeStatusUpdate()
+    String pendingStatus;
+    bool   statusPublished;
+    String pendingFirmware;
+    bool   firmwarePublished;
     
 	  Timer updateTimer;
 };
@@ -0,0 +1,137 @@
+#include <user_config.h>
+#include <SmingCore/SmingCore.h>
+#include <Perf.h>
+
+#if PERF_ENABLE
+
+#include <HTTP.h>
+#include <MySensors/MySensor.h>
+
+PerfClass Perf;
+
+static const char * const stageNames[PERF_STAGES] =
+{
+    "radioRx", "incomingMessage", "rules", "wsNotify", "mqttPublish",
+    "radioTx", "ioInput", "events"
+};
+
+void PerfClass::record(uint8_t stage, uint32_t cycles)
+{
+    PerfHistogram &h = stages[stage];
+    int bucket = cycles ? 31 - __builtin_clz(cycles) - PERF_MIN_SHIFT : 0;
+
+    bucket = constrain(bucket, 0, PERF_BUCKETS - 1);
+    h.buckets[bucket]++;
+    h.count++;
+    h.totalCycles += cycles;
+    if (cycles > h.maxCycles)
+        h.maxCycles = cycles;
+}
+
+/* The MySensors library times the radio through these hooks */
+uint32_t myStageStartHook(uint8_t stage)
+{
+    return perfCycles();
+}
+
+void myStageEndHook(uint8_t stage, uint32_t start)
+{
+    Perf.record(stage == MY_STAGE_RADIO_RX ? PERF_RADIO_RX : PERF_RADIO_TX,
+                perfCycles() - start);
+}
+
+void PerfClass::reset()
+{
+    memset(stages, 0, sizeof(stages));
+}
+
+/* Bucket limits in us at the current CPU clock, the last is open ended */
+static uint32_t bucketLimitUs(int bucket)
+{
+    return (1UL << (bucket + PERF_MIN_SHIFT + 1)) / system_get_cpu_freq();
+}
+
+void PerfClass::print(CommandOutput* out)
+{
+    uint32_t mhz = system_get_cpu_freq();
+
+    for (int s = 0; s < PERF_STAGES; s++)
+    {
+        PerfHistogram &h = stages[s];
+
+        out->printf("%-16s: %lu calls", stageNames[s], h.count);
+        if (h.count)
+            out->printf(", avg %lu us, max %lu us",
+                        (uint32_t)(h.totalCycles / h.count / mhz),
+                        h.maxCycles / mhz);
+        out->printf("\r\n");
+
+        for (int b = 0; b < PERF_BUCKETS; b++)
+        {
+            if (h.buckets[b] == 0)
+                continue;
+            if (b == PERF_BUCKETS - 1)
+                out->printf("    >= %7lu us : %lu\r\n",
+                            bucketLimitUs(b - 1), h.buckets[b]);
+            else
+                out->printf("    <  %7lu us : %lu\r\n",
+                            bucketLimitUs(b), h.buckets[b]);
+        }
+    }
+}
+
+/*
+ * GET /perf           the histograms as JSON, bucket limits in us
+ * GET /perf?reset=1   and start over afterwards
+ */
+void PerfClass::onHttpPerf(HttpRequest &request, HttpResponse &response)
+{
+    if (!HTTP.isHttpClientAllowed(request, response))
+        return;
+
+    uint32_t mhz = system_get_cpu_freq();
+    String json = "{\"cpuMhz\": " + String(mhz) + ", \"stages\": [";
+
+    for (int s = 0; s < PERF_STAGES; s++)
+    {
+        PerfHistogram &h = stages[s];
+
+        if (s > 0)
+            json += ",";
+        json += "{\"name\": \"" + String(stageNames[s]) + "\"";
+        json += ", \"count\": " + String(h.count);
+        json += ", \"avgUs\": " +
+                String(h.count ? (uint32_t)(h.totalCycles / h.count / mhz) : 0);
+        json += ", \"maxUs\": " + String(h.maxCycles / mhz);
+        json += ", \"buckets\": [";
+
+        /* [limit in us, count], a limit of 0 means open ended */
+        bool first = true;
+        for (int b = 0; b < PERF_BUCKETS; b++)
+        {
+            if (h.buckets[b] == 0)
+                continue;
+            if (!first)
+                json += ",";
+            first = false;
+            json += "[" + String(b == PERF_BUCKETS - 1 ? 0 : bucketLimitUs(b)) +
+                    "," + String(h.buckets[b]) + "]";
+        }
+        json += "]}";
+    }
+    json += "]}";
+
+    if (request.getQueryParameter("reset") == "1")
+        reset();
+
+    response.setAllowCrossDomainOrigin("*");
+    response.setContentType(ContentType::JSON);
+    response.sendString(json);
+}
+
+void PerfClass::registerHttpHandlers(HttpServer &server)
+{
+    server.addPath("/perf", HttpPathDelegate(&PerfClass::onHttpPerf, this));
+}
+
+#endif
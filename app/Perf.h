@@ -0,0 +1,92 @@
+#ifndef INCLUDE_PERF_H_
+#define INCLUDE_PERF_H_
+
+#include <user_config.h>
+#include <SmingCore/SmingCore.h>
+
+/*
+ * Cycle counter timing of the stages a packet goes through, from the
+ * radio to MQTT. Each stage keeps a histogram with one bucket per power
+ * of two cycles. incomingMessage only updates the sensor table and
+ * queues events; the rules, the WebSocket notification and queueing for
+ * MQTT run when the events are dispatched and nest in 'events'.
+ *
+ * Built with PERF_ENABLE=1 only, otherwise PERF_SCOPE() is empty and no
+ * RAM or code is spent.
+ */
+#ifndef PERF_ENABLE
+#define PERF_ENABLE 0
+#endif
+
+enum PerfStage
+{
+    PERF_RADIO_RX,      // reading and checking a packet from the radio
+    PERF_INCOMING,      // MyGateway::incomingMessage
+    PERF_RULES,         // running the rules a change triggers
+    PERF_WS_NOTIFY,     // pushing an update to WebSocket clients
+    PERF_MQTT_PUBLISH,  // flushing queued MQTT publishes
+    PERF_RADIO_TX,      // sending a packet over the radio
+    PERF_IO_INPUT,      // input changes read on an MCP23017 interrupt
+    PERF_EVENTS,        // handing one event to its subscribers
+    PERF_STAGES
+};
+
+#if PERF_ENABLE
+
+/* Bucket i counts calls of 2^(i + PERF_MIN_SHIFT) cycles up to twice that */
+#define PERF_BUCKETS     24
+#define PERF_MIN_SHIFT   6
+
+static inline uint32_t perfCycles()
+{
+    uint32_t ccount;
+    __asm__ __volatile__("rsr %0, ccount" : "=a"(ccount));
+    return ccount;
+}
+
+typedef struct
+{
+    uint32_t count;
+    uint32_t maxCycles;
+    uint64_t totalCycles;
+    uint32_t buckets[PERF_BUCKETS];
+} PerfHistogram;
+
+class PerfClass
+{
+  public:
+    void record(uint8_t stage, uint32_t cycles);
+    void reset();
+    void print(CommandOutput* out);
+    void registerHttpHandlers(HttpServer &server);
+
+  private:
+    void onHttpPerf(HttpRequest &request, HttpResponse &response);
+
+  private:
+    PerfHistogram stages[PERF_STAGES];
+};
+
+extern PerfClass Perf;
+
+/* Times the rest of the enclosing block */
+class PerfScope
+{
+  public:
+    PerfScope(uint8_t stage) : stage(stage), start(perfCycles()) {}
+    ~PerfScope() { Perf.record(stage, perfCycles() - start); }
+
+  private:
+    uint8_t  stage;
+    uint32_t start;
+};
+
+#define PERF_SCOPE(stage) PerfScope perfScope(stage)
+
+#else
+
+#define PERF_SCOPE(stage)
+
+#endif
+
+#endif //INCLUDE_PERF_H_
@@ -4,6 +4,8 @@
 #include <globals.h>
 #include <AppSettings.h>
 #include "RTClock.h"
+#include "i2c.h"
+#include "Event.h"
 
 #if RTC_TYPE == RTC_TYPE_3213
 #include "RTC/Sodaq_DS3231.h"
@@ -17,6 +19,12 @@ RTC_DS1307 rtc1307;
 RTClock Clock;
 
 void RTClock::checkState()
+{
+    I2CBus.submitJob(0x68, I2C_PRIO_CLOCK,
+                     I2CJobDelegate(&RTClock::readClock, this));
+}
+
+void RTClock::readClock()
 {
 #if RTC_TYPE == RTC_TYPE_3213
     SystemClock.setTime(rtc.now().getEpoch(), eTZ_UTC);
@@ -26,19 +34,16 @@ void RTClock::checkState()
     //read registers and display the temperature
     Debug.printf("Plug temperature %02f deg C\n",
                  rtc.getTemperature()); 
-    if (changeDlg)
-        changeDlg("RTC-temperature", String(rtc.getTemperature()));
+    Events.publishTemperature(rtc.getTemperature());
 #else
     SystemClock.setTime(rtc1307.now().unixtime(), eTZ_UTC);
 #endif
 }
 
-void RTClock::begin(RTCChangeDelegate dlg)
+void RTClock::begin()
 {
     byte error;
 
-    changeDlg = dlg;
-
 #if RTC_TYPE == RTC_TYPE_3213
     Wire.lock();
     Wire.beginTransmission(0x68);
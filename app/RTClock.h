@@ -6,21 +6,19 @@
 #include <SmingCore/Debug.h>
 #include <AppSettings.h>
 
-typedef Delegate<void(String, String)> RTCChangeDelegate;
-
 class RTClock
 {
   public:
-    void begin(RTCChangeDelegate dlg = NULL);
+    void begin();
     void setTime(uint32_t ts);
     uint32_t getTime();
 
   private:
     /* RTC */
     void checkState();
+    void readClock();
 
   private:
-    RTCChangeDelegate changeDlg;
     bool              RTCFound = FALSE;
 
     Timer             checkTimer;
@@ -1,5 +1,7 @@
 #include "Rule.h"
 #include "ScriptCore.h"
+#include "Logging.h"
+#include "Perf.h"
 
 Rule::Rule() : triggerObjects(1,1)
 {
@@ -37,6 +39,10 @@ void RuleController::begin()
 
         delete[] jsonString;
     }
+
+    Events.subscribe(EVENT_TOPIC_MASK(EVENT_IO) |
+                     EVENT_TOPIC_MASK(EVENT_SENSOR),
+                     EventDelegate(&RuleController::onEvent, this));
 }
 
 void RuleController::store()
@@ -102,6 +108,19 @@ void RuleController::addTrigger(String rule, String trigger)
     }
 }
 
+/*
+ * I/O objects and "sensor<n>" on a new value trigger rules. Every value
+ * set counts, also an unchanged one: a node repeating "1" for each press
+ * of a button must run the rule each time.
+ */
+void RuleController::onEvent(const Event &event)
+{
+    if (event.topic == EVENT_IO)
+        processTrigger(event.io.getName());
+    else if (event.topic == EVENT_SENSOR && event.sensor.set)
+        processTrigger(event.sensor.getName());
+}
+
 void RuleController::processTrigger(String trigger)
 {
     //Debug.printf("Processing trigger %s\n", trigger.c_str());
@@ -112,11 +131,13 @@ void RuleController::processTrigger(String trigger)
         return;
     }
 
+    PERF_SCOPE(PERF_RULES);
+
     for (int i = 0; i < triggers[trigger].size(); i++)
     {
         Rule *r = triggers[trigger][i];
 
-        Debug.printf("Executing rule %s\n", r->name.c_str());
+        LOG(RULES, LOG_DEBUG, "Executing rule %s", r->name.c_str());
         ScriptingCore.execute(r->script);
     }
 }
@@ -3,6 +3,7 @@
 
 #include <SmingCore.h>
 #include <SmingCore/Debug.h>
+#include <Event.h>
 
 class Rule
 {
@@ -25,6 +26,9 @@ class RuleController
     void addTrigger(String rule, String trigger);
     void processTrigger(String trigger);
 
+  private:
+    void onEvent(const Event &event);
+
   private:
     HashMap<String, Rule*>         rules;
     HashMap<String, Vector<Rule*>> triggers;    
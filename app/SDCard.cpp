@@ -7,10 +7,35 @@
 
 #include <AppSettings.h>
 
+#ifdef SD_SPI_SS_PIN
+bool sdCardMount()
+{
+	static bool mounted = false;
+
+	if (!mounted)
+		mounted = SD.begin(SD_SPI_SS_PIN);
+	return mounted;
+}
+#endif
+
 SdFileStream::SdFileStream(String fileName)
 {
 	Debug.printf("Opening file: %s\n", fileName.c_str());
 	handle = SD.open(fileName);
+	attach(fileName);
+}
+
+/* Take over a handle the caller already opened, so a path that has
+ * been looked up once is not opened a second time.
+ */
+SdFileStream::SdFileStream(File file)
+{
+	handle = file;
+	attach(handle ? handle.name() : "");
+}
+
+void SdFileStream::attach(String fileName)
+{
         if (!handle)
 	{
 		Debug.printf("File wasn't found: %s\n", fileName.c_str());
@@ -31,13 +56,18 @@ SdFileStream::SdFileStream(String fileName)
 
         // Set position
         pos = 0;
+	startTime = millis();
 
 	Debug.printf("send file: %s (%d bytes)\n", fileName.c_str(), size);
 }
 
 SdFileStream::~SdFileStream()
 {
-	Debug.printf("CLEANUP: %s\n", handle.name());
+	/* Throughput of the whole download, including network stalls */
+	uint32_t elapsed = millis() - startTime;
+	Debug.printf("CLEANUP: %s (%d bytes in %d ms, %d KB/s)\n",
+		     handle.name(), pos, elapsed,
+		     elapsed ? pos / elapsed : 0);
         handle.close();
 	//handle = 0;
 	pos = 0;
@@ -47,23 +77,29 @@ uint16_t SdFileStream::readMemoryBlock(char* data, int bufSize)
 {
 	uint32_t len = min(bufSize, size - pos);
 	len = min(1024, len);
-        Debug.printf("READ: %s len %d\n", handle.name(), len);
+
+	/* The caller only advances with seek() for what was actually sent.
+	 * Rewind the handle if the previous block was not fully consumed,
+	 * otherwise keep reading so the card can stream sequential blocks.
+	 */
+	if (handle.position() != pos && !handle.seek(pos))
+		return 0;
+
 	int available = handle.read(data, len);
-	return available;
+	return available < 0 ? 0 : available;
 }
 
 bool SdFileStream::seek(int len)
 {
-	if (len < 0) return false;
+	if (len < 0 || pos + len > size) return false;
 
-	bool result = fileSeek(handle, len, eSO_CurrentPos) >= 0;
-	if (result) pos += len;
-	return result;
+	pos += len;
+	return true;
 }
 
 bool SdFileStream::isFinished()
 {
-	return handle.available() < 1;
+	return pos >= size;
 }
 
 String SdFileStream::fileName()
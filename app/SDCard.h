@@ -12,6 +12,7 @@ class SdFileStream : public IDataSourceStream
 {
 public:
 	SdFileStream(String fileName);
+	SdFileStream(File file);
 	virtual ~SdFileStream();
 
 	virtual StreamType getStreamType() { return eSST_File; }
@@ -24,10 +25,20 @@ public:
 	bool fileExist();
 	inline int getPos() { return pos; }
 
+private:
+	void attach(String fileName);
+
 private:
 	File handle;
 	int pos;
 	int size;
+	uint32_t startTime;
 };
 
+#ifdef SD_SPI_SS_PIN
+/* SD.begin() only succeeds once since the root directory stays open, so
+ * everyone using the card mounts it through here. */
+bool sdCardMount();
+#endif
+
 #endif //INCLUDE_SDCARD_H_
@@ -1,5 +1,6 @@
 #include <SmingCore/SmingCore.h>
 #include <ScriptCore.h>
+#include <SensorStats.h>
 
 ScriptCore ScriptingCore;
 
@@ -19,6 +20,12 @@ ScriptCore::ScriptCore()
     addNative("function ToggleObjectValue(object)",
               &ScriptCore::staticToggleValueHandler,
               NULL);
+    addNative("function GetObjectStat(object, stat, seconds)",
+              &ScriptCore::staticGetStatHandler,
+              NULL);
+    addNative("function GetObjectSamples(object)",
+              &ScriptCore::staticGetSamplesHandler,
+              NULL);
 }
 
 void ScriptCore::staticDebugHandler(CScriptVar *v, void *userdata)
@@ -102,3 +109,57 @@ void ScriptCore::staticToggleValueHandler(CScriptVar *v, void *userdata)
     }
 }
 
+
+/*
+ * GetObjectStat("sensor3", "mean", 300): min, max, mean, rate (change per
+ * minute), count or last over the recent samples of a sensor. Without
+ * 'seconds' all samples kept are used. Undefined if there are none.
+ */
+void ScriptCore::staticGetStatHandler(CScriptVar *v, void *userdata)
+{
+    String object = v->getParameter("object")->getString();
+    String stat = v->getParameter("stat")->getString();
+    int seconds = v->getParameter("seconds")->getInt();
+    SensorStatsSummary stats;
+
+    if (!object.startsWith("sensor") ||
+        !SensorStats.getStats(object.substring(6).toInt() - 1,
+                              max(seconds, 0), stats))
+    {
+        v->getReturnVar()->setUndefined();
+        return;
+    }
+
+    if (stat.equals("min"))
+        v->getReturnVar()->setDouble(stats.min);
+    else if (stat.equals("max"))
+        v->getReturnVar()->setDouble(stats.max);
+    else if (stat.equals("mean"))
+        v->getReturnVar()->setDouble(stats.mean);
+    else if (stat.equals("rate"))
+        v->getReturnVar()->setDouble(stats.rate);
+    else if (stat.equals("count"))
+        v->getReturnVar()->setInt(stats.count);
+    else if (stat.equals("last"))
+        v->getReturnVar()->setDouble(stats.last);
+    else
+        v->getReturnVar()->setUndefined();
+}
+
+/* GetObjectSamples("sensor3"): the recent values of a sensor, oldest first */
+void ScriptCore::staticGetSamplesHandler(CScriptVar *v, void *userdata)
+{
+    String object = v->getParameter("object")->getString();
+    float values[SENSOR_STATS_SAMPLES];
+    uint32_t times[SENSOR_STATS_SAMPLES];
+    int n = 0;
+
+    if (object.startsWith("sensor"))
+        n = SensorStats.getSamples(object.substring(6).toInt() - 1,
+                                   values, times);
+
+    CScriptVar *result = v->getReturnVar();
+    result->setArray();
+    for (int i = 0; i < n; i++)
+        result->setArrayIndex(i, new CScriptVar((double)values[i]));
+}
@@ -19,6 +19,8 @@ private:
     static void staticGetValueHandler(CScriptVar *v, void *userdata);
     static void staticGetIntValueHandler(CScriptVar *v, void *userdata);
     static void staticToggleValueHandler(CScriptVar *v, void *userdata);
+    static void staticGetStatHandler(CScriptVar *v, void *userdata);
+    static void staticGetSamplesHandler(CScriptVar *v, void *userdata);
 
 public:
     // Locking //
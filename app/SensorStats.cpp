@@ -0,0 +1,367 @@
+#include <user_config.h>
+#include <SmingCore/SmingCore.h>
+#include <SmingCore/Debug.h>
+#include <SensorStats.h>
+#include <HTTP.h>
+#include <Wiring/SplitString.h>
+
+SensorStatsClass SensorStats;
+
+/* 10^decimals, from SENSOR_STATS_MIN_DECIMALS up */
+static const double scaleFactors[] =
+{
+    0.001, 0.01, 0.1, 1, 10, 100, 1000
+};
+
+static String formatValue(float value)
+{
+    char buf[24];
+
+    if (isnan(value) || isinf(value))
+        return "null";
+    return dtostrf(value, 1, 2, buf);
+}
+
+void SensorRing::clear()
+{
+    head = 0;
+    count = 0;
+    decimals = SENSOR_STATS_DECIMALS;
+}
+
+int32_t SensorRing::scale(float value)
+{
+    double scaled = value * scaleFactors[decimals - SENSOR_STATS_MIN_DECIMALS];
+
+    if (scaled > INT32_MAX)
+        return INT32_MAX;
+    if (scaled < INT32_MIN)
+        return INT32_MIN;
+    return scaled < 0 ? (int32_t)(scaled - 0.5) : (int32_t)(scaled + 0.5);
+}
+
+float SensorRing::unscale(int32_t value)
+{
+    return value / scaleFactors[decimals - SENSOR_STATS_MIN_DECIMALS];
+}
+
+bool SensorRing::fits(int32_t scaled)
+{
+    int32_t delta = scaled - last;
+
+    /* Keep well clear of the int32 limits so sums can't wrap either */
+    return scaled > INT32_MIN / 2 && scaled < INT32_MAX / 2 &&
+           delta >= INT16_MIN && delta <= INT16_MAX;
+}
+
+/* Drop a decimal: re-encode every sample at a tenth of the scale */
+void SensorRing::rescale()
+{
+    int32_t value = first;
+    int32_t prev = 0;
+
+    decimals--;
+    for (uint8_t i = 0; i < count; i++)
+    {
+        SensorSample &s = samples[slot(i)];
+        if (i > 0)
+            value += s.delta;
+
+        int32_t v = value < 0 ? (value - 5) / 10 : (value + 5) / 10;
+        if (i == 0)
+            first = v;
+        else
+            s.delta = v - prev;
+        prev = v;
+    }
+    last = prev;
+    recompute();
+}
+
+void SensorRing::recompute()
+{
+    int32_t value = first;
+
+    minValue = maxValue = first;
+    sum = first;
+    for (uint8_t i = 1; i < count; i++)
+    {
+        value += samples[slot(i)].delta;
+        sum += value;
+        if (value < minValue)
+            minValue = value;
+        if (value > maxValue)
+            maxValue = value;
+    }
+}
+
+void SensorRing::add(uint32_t time, float value)
+{
+    if (isnan(value) || isinf(value))
+        return;
+
+    if (count == 0)
+    {
+        decimals = SENSOR_STATS_DECIMALS;
+        while (decimals > SENSOR_STATS_MIN_DECIMALS &&
+               (scale(value) <= INT32_MIN / 2 || scale(value) >= INT32_MAX / 2))
+            decimals--;
+
+        first = last = minValue = maxValue = scale(value);
+        sum = first;
+        firstTime = lastTime = time;
+        samples[head].delta = 0;
+        samples[head].age = 0;
+        count = 1;
+        return;
+    }
+
+    /* Full, the second oldest sample becomes the base */
+    bool evictedExtreme = false;
+    if (count == SENSOR_STATS_SAMPLES)
+    {
+        int32_t old = first;
+
+        head = slot(1);
+        count--;
+        first += samples[head].delta;
+        firstTime += samples[head].age;
+        sum -= old;
+        evictedExtreme = old == minValue || old == maxValue;
+    }
+
+    while (!fits(scale(value)) && decimals > SENSOR_STATS_MIN_DECIMALS)
+    {
+        rescale();
+        evictedExtreme = false;
+    }
+
+    int32_t delta = scale(value) - last;
+    delta = constrain(delta, INT16_MIN, INT16_MAX);
+    uint32_t age = time > lastTime ? time - lastTime : 0;
+    age = min(age, (uint32_t)UINT16_MAX);
+
+    SensorSample &s = samples[slot(count)];
+    s.delta = delta;
+    s.age = age;
+    count++;
+
+    /* Times are rebuilt by adding up ages, stay consistent with that */
+    last += delta;
+    lastTime += age;
+    sum += last;
+
+    if (evictedExtreme)
+    {
+        recompute();
+    }
+    else
+    {
+        if (last < minValue)
+            minValue = last;
+        if (last > maxValue)
+            maxValue = last;
+    }
+}
+
+/* Decode the samples, oldest first. Returns how many there are. */
+int SensorRing::getSamples(float *values, uint32_t *times)
+{
+    int32_t value = first;
+    uint32_t time = firstTime;
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        if (i > 0)
+        {
+            value += samples[slot(i)].delta;
+            time += samples[slot(i)].age;
+        }
+        values[i] = unscale(value);
+        times[i] = time;
+    }
+    return count;
+}
+
+/*
+ * Statistics of the samples taken at or after 'since'. From the oldest
+ * sample on they are kept up to date, so that case costs nothing.
+ */
+bool SensorRing::getStats(uint32_t since, SensorStatsSummary &stats)
+{
+    if (count == 0 || lastTime < since)
+        return false;
+
+    stats.last = unscale(last);
+    stats.lastTime = lastTime;
+
+    if (since <= firstTime)
+    {
+        stats.count = count;
+        stats.min = unscale(minValue);
+        stats.max = unscale(maxValue);
+        stats.mean = unscale(sum / count);
+        stats.rate = lastTime > firstTime ?
+                     unscale(last - first) * 60 / (lastTime - firstTime) : 0;
+        return true;
+    }
+
+    float values[SENSOR_STATS_SAMPLES];
+    uint32_t times[SENSOR_STATS_SAMPLES];
+    int n = getSamples(values, times);
+    int start = 0;
+    float total = 0;
+
+    while (times[start] < since)
+        start++;
+
+    stats.count = n - start;
+    stats.min = stats.max = values[start];
+    for (int i = start; i < n; i++)
+    {
+        total += values[i];
+        if (values[i] < stats.min)
+            stats.min = values[i];
+        if (values[i] > stats.max)
+            stats.max = values[i];
+    }
+    stats.mean = total / stats.count;
+    stats.rate = lastTime > times[start] ?
+                 (stats.last - values[start]) * 60 / (lastTime - times[start]) : 0;
+    return true;
+}
+
+SensorStatsClass::SensorStatsClass()
+{
+    for (int i = 0; i < MAX_MY_SENSORS; i++)
+        rings[i].clear();
+}
+
+void SensorStatsClass::add(int index, const String &value)
+{
+    char *end;
+
+    if (index < 0 || index >= MAX_MY_SENSORS)
+        return;
+
+    float v = strtod(value.c_str(), &end);
+    if (end == value.c_str())
+        return; // not a number
+
+    rings[index].add(SystemClock.now(eTZ_UTC).toUnixTime(), v);
+}
+
+void SensorStatsClass::clear(int index)
+{
+    if (index >= 0 && index < MAX_MY_SENSORS)
+        rings[index].clear();
+}
+
+/* Statistics over the last 'seconds', or over all samples if 0 */
+bool SensorStatsClass::getStats(int index, uint32_t seconds,
+                                SensorStatsSummary &stats)
+{
+    if (index < 0 || index >= MAX_MY_SENSORS)
+        return false;
+
+    uint32_t now = SystemClock.now(eTZ_UTC).toUnixTime();
+    uint32_t since = seconds && now > seconds ? now - seconds : 0;
+    return rings[index].getStats(since, stats);
+}
+
+int SensorStatsClass::getSamples(int index, float *values, uint32_t *times)
+{
+    if (index < 0 || index >= MAX_MY_SENSORS)
+        return 0;
+    return rings[index].getSamples(values, times);
+}
+
+String SensorStatsClass::getJson(int index)
+{
+    SensorStatsSummary stats;
+    float values[SENSOR_STATS_SAMPLES];
+    uint32_t times[SENSOR_STATS_SAMPLES];
+
+    String json = "{\"type\": \"sensorStats\", \"data\" : {\"id\": " +
+                  String(index + 1);
+    if (getStats(index, 0, stats))
+    {
+        json += ",\"count\": " + String(stats.count);
+        json += ",\"min\": " + formatValue(stats.min);
+        json += ",\"max\": " + formatValue(stats.max);
+        json += ",\"mean\": " + formatValue(stats.mean);
+        json += ",\"rate\": " + formatValue(stats.rate);
+    }
+    else
+    {
+        json += ",\"count\": 0";
+    }
+
+    json += ",\"samples\": [";
+    int n = getSamples(index, values, times);
+    for (int i = 0; i < n; i++)
+    {
+        if (i > 0)
+            json += ",";
+        json += "[" + String(times[i]) + "," + formatValue(values[i]) + "]";
+    }
+    json += "]}}";
+    return json;
+}
+
+//USAGE: /ajax/getSensorStats?sensor=<node>/<sensor>
+void SensorStatsClass::onGetSensorStats(HttpRequest &request,
+                                        HttpResponse &response)
+{
+    if (!HTTP.isHttpClientAllowed(request, response))
+        return;
+
+    String sensor = request.getQueryParameter("sensor");
+    int slash = sensor.indexOf('/');
+    int index = slash > 0 ?
+                GW.getSensorIndex(sensor.substring(0, slash).toInt(),
+                                  sensor.substring(slash + 1).toInt()) : -1;
+
+    if (index < 0)
+    {
+        response.notFound();
+        return;
+    }
+
+    response.setAllowCrossDomainOrigin("*");
+    response.setContentType(ContentType::JSON);
+    response.sendString(getJson(index));
+}
+
+//USAGE: getSensorStats <node> <sensor>
+void SensorStatsClass::onWsGetSensorStats(WebSocket& socket,
+                                          const String& message)
+{
+    Vector<String> commandToken;
+    int numToken = splitString((String &)message, ' ' , commandToken);
+
+    if (numToken != 3)
+    {
+        socket.sendString("{\"status\" : \"error\", \"msg\" : \"invalid number of args\"}");
+        return;
+    }
+
+    int index = GW.getSensorIndex(commandToken[1].toInt(),
+                                  commandToken[2].toInt());
+    if (index < 0)
+    {
+        socket.sendString("{\"status\" : \"error\", \"msg\" : \"sensor not found\"}");
+        return;
+    }
+
+    socket.sendString(getJson(index));
+}
+
+void SensorStatsClass::registerHttpHandlers(HttpServer &server)
+{
+    server.addPath("/ajax/getSensorStats",
+                   HttpPathDelegate(&SensorStatsClass::onGetSensorStats, this));
+
+    HTTP.addWsCommand("getSensorStats",
+                      WebSocketMessageDelegate(&SensorStatsClass::onWsGetSensorStats, this));
+}
@@ -0,0 +1,91 @@
+#ifndef INCLUDE_SENSORSTATS_H_
+#define INCLUDE_SENSORSTATS_H_
+
+#include <user_config.h>
+#include <SmingCore/SmingCore.h>
+#include <SmingCore/Debug.h>
+#include <MyGateway.h>
+
+/*
+ * The last few numeric readings of every sensor, kept in RAM so scripts
+ * and the web UI can look at trends without an SD card. A sample is the
+ * change since the previous one, scaled to fit an int16, plus the seconds
+ * in between. The scale drops a decimal whenever a change doesn't fit.
+ */
+#ifndef SENSOR_STATS_SAMPLES
+#define SENSOR_STATS_SAMPLES     16  // per sensor
+#endif
+#define SENSOR_STATS_DECIMALS    2   // scale of a fresh ring
+#define SENSOR_STATS_MIN_DECIMALS -3 // coarsest scale, 1000 per step
+
+typedef struct
+{
+    int16_t  delta;     // scaled change since the previous sample
+    uint16_t age;       // seconds since the previous sample, saturated
+} SensorSample;
+
+typedef struct
+{
+    uint16_t count;
+    float    min;
+    float    max;
+    float    mean;
+    float    rate;      // change per minute, first to last sample
+    float    last;
+    uint32_t lastTime;
+} SensorStatsSummary;
+
+class SensorRing
+{
+  public:
+    void clear();
+    void add(uint32_t time, float value);
+    uint8_t getCount() { return count; }
+    int getSamples(float *values, uint32_t *times);
+    bool getStats(uint32_t since, SensorStatsSummary &stats);
+
+  private:
+    int32_t scale(float value);
+    float unscale(int32_t value);
+    bool fits(int32_t scaled);
+    void rescale();
+    void recompute();
+    uint8_t slot(uint8_t n) { return (head + n) % SENSOR_STATS_SAMPLES; }
+
+  private:
+    SensorSample samples[SENSOR_STATS_SAMPLES];
+    uint8_t  head;      // oldest sample
+    uint8_t  count;
+    int8_t   decimals;  // values are stored times 10^decimals
+    int32_t  first;     // scaled value of the oldest sample
+    int32_t  last;      // scaled value of the newest sample
+    uint32_t firstTime;
+    uint32_t lastTime;
+    int32_t  minValue;
+    int32_t  maxValue;
+    int64_t  sum;
+};
+
+class SensorStatsClass
+{
+  public:
+    SensorStatsClass();
+
+    void add(int index, const String &value);
+    void clear(int index);
+    bool getStats(int index, uint32_t seconds, SensorStatsSummary &stats);
+    int getSamples(int index, float *values, uint32_t *times);
+    String getJson(int index);
+    void registerHttpHandlers(HttpServer &server);
+
+  private:
+    void onGetSensorStats(HttpRequest &request, HttpResponse &response);
+    void onWsGetSensorStats(WebSocket& socket, const String& message);
+
+  private:
+    SensorRing rings[MAX_MY_SENSORS]; // by slot in GW's sensor table
+};
+
+extern SensorStatsClass SensorStats;
+
+#endif //INCLUDE_SENSORSTATS_H_
@@ -0,0 +1,226 @@
+#include <user_config.h>
+#include <SmingCore/SmingCore.h>
+#include <SmingCore/Debug.h>
+#include <SmingCore/DataSourceStream.h>
+#include <StaticFiles.h>
+#include <SDCard.h>
+
+#ifndef HTTP_NOT_MODIFIED
+#define HTTP_NOT_MODIFIED "304 Not Modified"
+#endif
+
+StaticFilesClass StaticFiles;
+
+String StaticFilesClass::computeETag(const String &fileName)
+{
+    char buf[128];
+    char etag[11];
+    uint32_t hash = 2166136261; // FNV-1a offset basis
+    int len;
+
+    file_t f = fileOpen(fileName, eFO_ReadOnly);
+    while ((len = fileRead(f, buf, sizeof(buf))) > 0)
+    {
+        for (int i = 0; i < len; i++)
+        {
+            hash ^= (uint8_t)buf[i];
+            hash *= 16777619; // FNV-1a prime
+        }
+
+        /* Let the watchdog know we're not crashed */
+        WDT.alive();
+    }
+    fileClose(f);
+
+    sprintf(etag, "\"%08x\"", hash);
+    return etag;
+}
+
+void StaticFilesClass::begin()
+{
+    Vector<String> list = fileList();
+
+    for (int i = 0; i < files.count(); i++)
+        delete files.valueAt(i);
+    files.clear();
+
+    for (int i = 0; i < list.count(); i++)
+    {
+        String name = list[i];
+        bool gzipped = name.endsWith(".gz");
+
+        /* Settings and other hidden files are never served */
+        if (name[0] == '.')
+            continue;
+
+        String key = gzipped ? name.substring(0, name.length() - 3) : name;
+        if (!files.contains(key))
+            files[key] = new StaticFile();
+
+        StaticFile *f = files[key];
+        if (gzipped)
+        {
+            f->gzipName = name;
+            f->gzipETag = computeETag(name);
+            f->gzipSize = fileGetSize(name);
+        }
+        else
+        {
+            f->plainName = name;
+            f->plainETag = computeETag(name);
+            f->plainSize = fileGetSize(name);
+        }
+    }
+
+    Debug.printf("Indexed %d static files\n", files.count());
+}
+
+/*
+ * FTP can replace or delete files after boot. A changed size gets a new
+ * tag; a replacement of the same size keeps the old one until reboot.
+ * Returns false, and forgets the name, when the file is gone.
+ */
+bool StaticFilesClass::checkFile(String &name, String &etag, int &size)
+{
+    if (name.length() == 0)
+        return false;
+
+    if (!fileExist(name))
+    {
+        Debug.printf("Static file %s was removed\n", name.c_str());
+        name = "";
+        etag = "";
+        size = 0;
+        return false;
+    }
+
+    int currentSize = fileGetSize(name);
+    if (currentSize != size)
+    {
+        Debug.printf("Static file %s was changed\n", name.c_str());
+        etag = computeETag(name);
+        size = currentSize;
+    }
+    return true;
+}
+
+bool StaticFilesClass::notModified(HttpRequest &request,
+                                   HttpResponse &response,
+                                   const String &etag)
+{
+    response.setHeader("ETag", etag);
+
+    String ifNoneMatch = request.getHeader("If-None-Match");
+    if (ifNoneMatch.length() == 0 || ifNoneMatch.indexOf(etag) < 0)
+        return false;
+
+    response.setStatusCode(HTTP_NOT_MODIFIED);
+    return true;
+}
+
+#ifdef SD_SPI_SS_PIN
+bool StaticFilesClass::sendFromSd(HttpRequest &request,
+                                  HttpResponse &response,
+                                  const String &file)
+{
+    if (!sdCardMount())
+        return false;
+
+    // open the file. note that only one file can be open at a time,
+    // so the handle is passed on to the stream instead of reopening.
+    File f = SD.open(file);
+    if (!f) //SD.exists(file) does not seem to work
+        return false;
+
+    if (f.isDirectory())
+    {
+        f.close();
+        Debug.printf("%s IS A DIRECTORY\n", file.c_str());
+        response.forbidden();
+        return true;
+    }
+
+    /* SD content can change behind our back, so the tag is derived
+     * from the directory entry rather than cached. */
+    char etag[24];
+    sprintf(etag, "\"%x-%x\"", f.size(), f.lastWrite());
+    if (notModified(request, response, etag))
+    {
+        f.close();
+        return true;
+    }
+
+    response.setAllowCrossDomainOrigin("*");
+    const char *mime = ContentType::fromFullFileName(file);
+    if (mime != NULL)
+        response.setContentType(mime);
+    response.sendDataStream(new SdFileStream(f));
+    return true;
+}
+#endif
+
+void StaticFilesClass::sendFromSpiffs(HttpRequest &request,
+                                      HttpResponse &response,
+                                      const String &file)
+{
+    int idx = files.indexOf(file);
+    if (idx < 0)
+    {
+        /* Uploaded after boot, let Sming find it the slow way */
+        response.sendFile(file);
+        return;
+    }
+
+    StaticFile *f = files.valueAt(idx);
+    checkFile(f->plainName, f->plainETag, f->plainSize);
+    checkFile(f->gzipName, f->gzipETag, f->gzipSize);
+    if (f->plainName.length() == 0 && f->gzipName.length() == 0)
+    {
+        files.removeAt(idx);
+        delete f;
+        response.sendFile(file); // answers 404 when it is really gone
+        return;
+    }
+
+    bool useGzip = f->gzipName.length() > 0 &&
+                   (f->plainName.length() == 0 ||
+                    request.getHeader("Accept-Encoding").indexOf("gzip") >= 0);
+
+    if (f->plainName.length() > 0 && f->gzipName.length() > 0)
+        response.setHeader("Vary", "Accept-Encoding");
+
+    if (notModified(request, response,
+                    useGzip ? f->gzipETag : f->plainETag))
+        return;
+
+    if (useGzip)
+        response.setHeader("Content-Encoding", "gzip");
+
+    const char *mime = ContentType::fromFullFileName(file);
+    if (mime != NULL)
+        response.setContentType(mime);
+    response.sendDataStream(new FileStream(useGzip ? f->gzipName :
+                                                     f->plainName));
+}
+
+void StaticFilesClass::send(HttpRequest &request, HttpResponse &response,
+                            String file)
+{
+    if (file[0] == '/')
+        file = file.substring(1);
+
+    if (file[0] == '.')
+    {
+        response.forbidden();
+        return;
+    }
+
+    response.setCache(86400, true); // It's important to use cache for better performance.
+
+#ifdef SD_SPI_SS_PIN
+    if (sendFromSd(request, response, file))
+        return;
+#endif
+
+    sendFromSpiffs(request, response, file);
+}
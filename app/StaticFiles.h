@@ -0,0 +1,49 @@
+#ifndef INCLUDE_STATICFILES_H_
+#define INCLUDE_STATICFILES_H_
+
+#include <user_config.h>
+#include <SmingCore/SmingCore.h>
+#include <SmingCore/Debug.h>
+
+/*
+ * A static asset as stored on SPIFFS. A file can be present uncompressed,
+ * pre-gzipped (<name>.gz) or both. The ETags are computed at boot and
+ * again when FTP changes the size of a file; a file removed after boot
+ * is dropped from the index on its next request.
+ */
+class StaticFile
+{
+  public:
+    String plainName;
+    String plainETag;
+    int plainSize = 0;
+    String gzipName;
+    String gzipETag;
+    int gzipSize = 0;
+};
+
+class StaticFilesClass
+{
+  public:
+    void begin();
+    void send(HttpRequest &request, HttpResponse &response, String file);
+
+  private:
+#ifdef SD_SPI_SS_PIN
+    bool sendFromSd(HttpRequest &request, HttpResponse &response,
+                    const String &file);
+#endif
+    void sendFromSpiffs(HttpRequest &request, HttpResponse &response,
+                        const String &file);
+    bool notModified(HttpRequest &request, HttpResponse &response,
+                     const String &etag);
+    static String computeETag(const String &fileName);
+    static bool checkFile(String &name, String &etag, int &size);
+
+  private:
+    HashMap<String, StaticFile*> files;
+};
+
+extern StaticFilesClass StaticFiles;
+
+#endif //INCLUDE_STATICFILES_H_
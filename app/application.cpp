@@ -5,12 +5,17 @@
 #include <globals.h>
 #include <i2c.h>
 #include <IOExpansion.h>
+#include <Event.h>
 #include <RTClock.h>
 #include <Network.h>
 #include <SDCard.h>
+#include <History.h>
+#include <Logging.h>
+#include <Perf.h>
 #include <MyGateway.h>
 #include <HTTP.h>
 #include <controller.h>
+#include <mqtt.h>
 #include <Rule.h>
 #include "MyStatus.h"
 #include "MyDisplay.h"
@@ -34,33 +39,28 @@ static boolean first_time = TRUE;
 int isNetworkConnected = FALSE;
 int pongNodeId = 22;
 
-char convBuf[MAX_PAYLOAD*2+1];
 MyStatus myStatus;
 
 
-void incomingMessage(const MyMessage &message)
+/* Logging of what the radio brought in, after the gateway handled it */
+void radioRxHandler(const Event &event)
 {
-    // Pass along the message from sensors to serial line
-    Debug.printf("APP RX %d;%d;%d;%d;%d;%s\n",
-                  message.sender, message.sensor,
-                  mGetCommand(message), mGetAck(message),
-                  message.type, message.getString(convBuf));
+    const MyMessage &message = event.getMessage();
 
-    if (GW.getSensorTypeString(message.type) == "VAR2") 
-    {
-        Debug.printf("received pong\n");
-    }
+    LOG_DEFER_S(GW, LOG_DEBUG, GW.getPayloadString(message),
+                "APP RX %d;%d;%d;%d;%d;%s",
+                message.sender, message.sensor,
+                mGetCommand(message), mGetAck(message), message.type);
 
-    if (mGetCommand(message) == C_SET)
+    if (message.type == V_VAR2)
     {
-        String type = GW.getSensorTypeString(message.type);
-        String topic = message.sender + String("/") +
-                       message.sensor + String("/") +
-                       "V_" + type;
-        controller.notifyChange(topic, message.getString(convBuf));
+        LOG(GW, LOG_INFO, "received pong");
     }
 
-    return;
+#ifdef SD_SPI_SS_PIN
+    if (mGetCommand(message) == C_SET)
+        History.log(message);
+#endif
 }
 
 void startFTP()
@@ -89,15 +89,7 @@ int updateSensorState(int node, int sensor, int value)
 Timer heapCheckTimer;
 void heapCheckUsage()
 {
-    uint32 freeHeap = system_get_free_heap_size();
-    controller.notifyChange("memory", String(freeHeap));
-    getStatusObj().updateFreeHeapSize (freeHeap);
-}
-
-void i2cChangeHandler(String object, String value)
-{
-    controller.notifyChange(object, value);
-    Rules.processTrigger(object);
+    Events.publishSystem(SYSTEM_FREE_HEAP, system_get_free_heap_size());
 }
 
 // Will be called when system initialization was completed
@@ -109,8 +101,8 @@ void startServers()
 
     I2C_dev.begin();
     Display.begin();
-    Expansion.begin(i2cChangeHandler);
-    Clock.begin(i2cChangeHandler);
+    Expansion.begin();
+    Clock.begin();
 
     heapCheckTimer.initializeMs(60000, heapCheckUsage).start(true);
 
@@ -119,7 +111,8 @@ void startServers()
     controller.begin();
 
     // start getting sensor data
-    GW.begin(incomingMessage, NULL);
+    Events.subscribe(EVENT_TOPIC_MASK(EVENT_RADIO_RX), radioRxHandler);
+    GW.begin();
     myStatus.begin();
 }
 
@@ -143,8 +136,37 @@ void wifiCb(bool connected)
 // Adafruit SD shields and modules: pin 10
 // Sparkfun SD shield: pin 8
 const int chipSelect = 0;
+void printSdCacheStats(CommandOutput* out)
+{
+  static const char *names[SdVolume::CACHE_PRIORITY_COUNT] =
+    { "data", "dir", "fat" };
+
+  out->printf("Block cache: %d blocks\n", SdVolume::cacheBlockCount());
+  for (int i = 0; i < SdVolume::CACHE_PRIORITY_COUNT; i++)
+  {
+    out->printf("  %-4s : %lu hits, %lu misses\n", names[i],
+                SdVolume::cacheHits(i), SdVolume::cacheMisses(i));
+  }
+  out->printf("  writes back : %lu\n", SdVolume::cacheWrites());
+}
+
 void processSD(String commandLine, CommandOutput* out)
 {
+  Vector<String> commandToken;
+  int numToken = splitString(commandLine, ' ' , commandToken);
+
+  // the cache is shared by all volumes, no need to touch the card
+  if (numToken == 2 && commandToken[1] == "cache")
+  {
+    printSdCacheStats(out);
+    return;
+  }
+  if (numToken == 2 && commandToken[1] == "reset")
+  {
+    SdVolume::cacheResetStats();
+    return;
+  }
+
   out->printf("Initializing SD card...\n");
 
   // we'll use the initialization code from the utility libraries
@@ -203,9 +225,184 @@ void processSD(String commandLine, CommandOutput* out)
 
   // list all files in the card with date and size
   root.ls(LS_R | LS_DATE | LS_SIZE);
+
+  out->printf("\n");
+  printSdCacheStats(out);
+}
+
+/*
+ * Read a file through the same stream the web server uses for SD
+ * downloads (onFile), without the network, to measure card throughput.
+ */
+void processSdBenchCommand(String commandLine, CommandOutput* out)
+{
+    Vector<String> commandToken;
+    int numToken = splitString(commandLine, ' ' , commandToken);
+
+    if (numToken != 2)
+    {
+        out->printf("usage : \r\n\r\n");
+        out->printf("sdbench <file> : Time reading a file from SD\r\n");
+        return;
+    }
+
+    if (!sdCardMount())
+    {
+        out->printf("SD card initialization failed\r\n");
+        return;
+    }
+
+    SdFileStream stream(commandToken[1]);
+    if (!stream.fileExist())
+    {
+        out->printf("Can't open %s\r\n", commandToken[1].c_str());
+        return;
+    }
+
+    char *buf = new char[1024];
+    uint32_t total = 0;
+    uint32_t start = millis();
+    while (!stream.isFinished())
+    {
+        uint16_t len = stream.readMemoryBlock(buf, 1024);
+        if (len == 0 || !stream.seek(len))
+            break;
+        total += len;
+        WDT.alive();
+    }
+    uint32_t elapsed = millis() - start;
+    delete[] buf;
+
+    out->printf("%s: %d bytes in %d ms", commandToken[1].c_str(),
+                total, elapsed);
+    if (elapsed > 0)
+        out->printf(", %d KB/s", total / elapsed);
+    out->printf("\r\n");
+}
+
+void processHistoryCommand(String commandLine, CommandOutput* out)
+{
+    Vector<String> commandToken;
+    int numToken = splitString(commandLine, ' ' , commandToken);
+
+    if (numToken == 2 && commandToken[1] == "flush")
+        History.flush();
+    else if (numToken != 1)
+    {
+        out->printf("usage : \r\n\r\n");
+        out->printf("history       : Show the sensor history log state\r\n");
+        out->printf("history flush : Write pending records to SD\r\n");
+        return;
+    }
+
+    History.printStatus(out);
 }
 #endif
 
+void processLogCommand(String commandLine, CommandOutput* out)
+{
+    Vector<String> commandToken;
+    int numToken = splitString(commandLine, ' ' , commandToken);
+
+    if (numToken == 1)
+        Log.print(out);
+    else if (numToken == 2 && commandToken[1] == "clear")
+        Log.clear();
+    else if (numToken == 2 && commandToken[1] == "level")
+        Log.printLevels(out);
+    else if (numToken == 4 && commandToken[1] == "level" &&
+             Log.setLevel(commandToken[2], commandToken[3]))
+        Log.printLevels(out);
+    else
+    {
+        out->printf("usage : \r\n\r\n");
+        out->printf("log                         : Show the deferred log records\r\n");
+        out->printf("log clear                   : Forget the deferred log records\r\n");
+        out->printf("log level                   : Show the log level of each module\r\n");
+        out->printf("log level <module> <level>  : Set the log level of a module\r\n");
+        out->printf("                              (module gw|radio|mqtt|rules|all,\r\n");
+        out->printf("                               level none|error|warn|info|debug)\r\n");
+    }
+}
+
+#if PERF_ENABLE
+void processPerfCommand(String commandLine, CommandOutput* out)
+{
+    Vector<String> commandToken;
+    int numToken = splitString(commandLine, ' ' , commandToken);
+
+    if (numToken == 2 && commandToken[1] == "reset")
+        Perf.reset();
+    else if (numToken != 1)
+    {
+        out->printf("usage : \r\n\r\n");
+        out->printf("perf       : Show the time spent per packet stage\r\n");
+        out->printf("perf reset : Clear the histograms\r\n");
+        return;
+    }
+
+    Perf.print(out);
+}
+#endif
+
+void processIOCommand(String commandLine, CommandOutput* out)
+{
+    Vector<String> commandToken;
+    int numToken = splitString(commandLine, ' ' , commandToken);
+
+    if (numToken == 2 && commandToken[1] == "rescan")
+    {
+        Expansion.loadConfig();
+        Expansion.rescan();
+    }
+    else if (numToken != 1)
+    {
+        out->printf("usage : \r\n\r\n");
+        out->printf("io        : Show the I/O expanders and digital pins\r\n");
+        out->printf("io rescan : Reload %s and look for expanders\r\n",
+                    IO_CONFIG_FILE);
+        return;
+    }
+
+    Expansion.print(out);
+}
+
+void processEventsCommand(String commandLine, CommandOutput* out)
+{
+    Vector<String> commandToken;
+    int numToken = splitString(commandLine, ' ' , commandToken);
+
+    if (numToken == 2 && commandToken[1] == "reset")
+        Events.reset();
+    else if (numToken != 1)
+    {
+        out->printf("usage : \r\n\r\n");
+        out->printf("events       : Show the event counts per topic\r\n");
+        out->printf("events reset : Clear the counts\r\n");
+        return;
+    }
+
+    Events.print(out);
+}
+
+void processI2CCommand(String commandLine, CommandOutput* out)
+{
+    Vector<String> commandToken;
+    int numToken = splitString(commandLine, ' ' , commandToken);
+
+    if (numToken == 2 && commandToken[1] == "reset")
+        I2CBus.reset();
+    else if (numToken != 1)
+    {
+        out->printf("usage : \r\n\r\n");
+        out->printf("i2c       : Show the I2C bus time per device\r\n");
+        out->printf("i2c reset : Clear the statistics\r\n");
+        return;
+    }
+
+    I2CBus.print(out);
+}
+
 void processInfoCommand(String commandLine, CommandOutput* out)
 {
     uint64_t rfBaseAddress = GW.getBaseAddress();
@@ -232,6 +429,8 @@ void processInfoCommand(String commandLine, CommandOutput* out)
         out->printf("DHCP               : %s\n", AppSettings.dhcp ? "TRUE" : "FALSE");
         extern IPAddress w5100_netif_get_ip();
         out->printf("Wired IP           : %s\n", Network.getClientIP().toString().c_str());
+        extern void w5100_netif_print(CommandOutput* out);
+        w5100_netif_print(out);
     }
 #endif
     uint8 hwaddr[6];
@@ -262,15 +461,29 @@ void processInfoCommand(String commandLine, CommandOutput* out)
     out->printf("RF base address    : %02x", (rfBaseAddress >> 32) & 0xff);
     out->printf("%08x\r\n", rfBaseAddress);
     out->printf("\r\n");
+    out->printf("MQTT received      : %lu (%lu dropped)\r\n",
+                mqttPktRx, mqttPktDropped);
+    out->printf("MQTT publishes     : %lu\r\n", mqttPktTx);
+    out->printf("MQTT flushes       : %lu (max %lu per flush)\r\n",
+                mqttPublishFlushes, mqttPublishMaxPerFlush);
+    out->printf("\r\n");
 }
 
 void processRestartCommand(String commandLine, CommandOutput* out)
 {
+    hw_commitConfig();
+#ifdef SD_SPI_SS_PIN
+    History.flush();
+#endif
     System.restart();
 }
 
 void processRestartCommandWeb(void)
 {
+    hw_commitConfig();
+#ifdef SD_SPI_SS_PIN
+    History.flush();
+#endif
     System.restart();
 }
 
@@ -346,6 +559,7 @@ void processBaseAddressCommand(String commandLine, CommandOutput* out)
     }
 
     AppSettings.save();
+    hw_commitConfig();
     System.restart();
 }
 
@@ -453,6 +667,7 @@ void processAPModeCommand(String commandLine, CommandOutput* out)
     }
 
     AppSettings.save();
+    hw_commitConfig();
     System.restart();
 }
 
@@ -507,6 +722,28 @@ void init()
                                                    "Enable or disable debugging",
                                                    "System",
                                                    processDebugCommand));
+    commandHandler.registerCommand(CommandDelegate("log",
+                                                   "Show the log, set log levels",
+                                                   "System",
+                                                   processLogCommand));
+    commandHandler.registerCommand(CommandDelegate("io",
+                                                   "Show I/O pins, 'io rescan' reloads the pin map",
+                                                   "System",
+                                                   processIOCommand));
+    commandHandler.registerCommand(CommandDelegate("events",
+                                                   "Show event bus counts, 'events reset' clears",
+                                                   "System",
+                                                   processEventsCommand));
+    commandHandler.registerCommand(CommandDelegate("i2c",
+                                                   "Show I2C bus time per device, 'i2c reset' clears",
+                                                   "System",
+                                                   processI2CCommand));
+#if PERF_ENABLE
+    commandHandler.registerCommand(CommandDelegate("perf",
+                                                   "Show packet path timing, 'perf reset' clears",
+                                                   "System",
+                                                   processPerfCommand));
+#endif
     commandHandler.registerCommand(CommandDelegate("restart",
                                                    "Restart the system",
                                                    "System",
@@ -521,9 +758,17 @@ void init()
                                                    processAPModeCommand));
 #ifdef SD_SPI_SS_PIN
     commandHandler.registerCommand(CommandDelegate("sd",
-                                                   "Test SD",
+                                                   "Test SD, 'sd cache' shows cache statistics",
                                                    "System",
                                                    processSD));
+    commandHandler.registerCommand(CommandDelegate("sdbench",
+                                                   "Measure SD read throughput",
+                                                   "System",
+                                                   processSdBenchCommand));
+    commandHandler.registerCommand(CommandDelegate("history",
+                                                   "Sensor history log on SD",
+                                                   "MySensors",
+                                                   processHistoryCommand));
 #endif
     commandHandler.registerCommand(CommandDelegate("js",
                                                    "Test JS",
@@ -0,0 +1,37 @@
+#include <user_config.h>
+#include <SmingCore/SmingCore.h>
+#include <controller.h>
+#include <MyGateway.h>
+
+/*
+ * Local I/O changes, values set by radio nodes and the free memory are
+ * passed on to the controller as object name and value.
+ */
+void Controller::subscribeEvents()
+{
+    Events.subscribe(EVENT_TOPIC_MASK(EVENT_IO) |
+                     EVENT_TOPIC_MASK(EVENT_RADIO_RX) |
+                     EVENT_TOPIC_MASK(EVENT_SYSTEM),
+                     EventDelegate(&Controller::onEvent, this));
+}
+
+void Controller::onEvent(const Event &event)
+{
+    if (event.topic == EVENT_IO)
+    {
+        notifyChange(event.io.getName(), event.io.getValue());
+    }
+    else if (event.topic == EVENT_RADIO_RX)
+    {
+        const MyMessage &message = event.getMessage();
+
+        if (mGetCommand(message) == C_SET)
+            notifyChange(GW.getSensorTopic(message),
+                         GW.getPayloadString(message));
+    }
+    else if (event.topic == EVENT_SYSTEM &&
+             event.system.kind == SYSTEM_FREE_HEAP)
+    {
+        notifyChange("memory", String(event.system.value));
+    }
+}
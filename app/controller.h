@@ -4,6 +4,7 @@
 #include <user_config.h>
 #include <SmingCore/SmingCore.h>
 #include <globals.h>
+#include <Event.h>
 
 class Controller
 {
@@ -12,6 +13,12 @@ class Controller
     virtual void notifyChange(String object, String value) = 0;
     virtual void registerHttpHandlers(HttpServer &server) = 0;
     virtual void registerCommandHandlers() = 0;
+
+  protected:
+    void subscribeEvents();
+
+  private:
+    void onEvent(const Event &event);
 };
 
 #if CONTROLLER_TYPE == CONTROLLER_TYPE_OPENHAB
@@ -84,3 +84,227 @@ void MyI2C::begin()
         }
     }
 }
+
+I2CBusClass I2CBus;
+
+/*
+ * Up to I2C_MAX_DATA bytes are read into the request, more can be read
+ * into a buffer that has to stay around until the callback ran.
+ */
+bool I2CBusClass::read(uint8_t address, uint8_t reg, uint8_t len,
+                       uint8_t priority, I2CDoneDelegate done,
+                       uint8_t *buffer)
+{
+    I2CRequest request;
+
+    if (len > (buffer ? I2C_MAX_READ : I2C_MAX_DATA))
+        return false;
+
+    request.address = address;
+    request.priority = priority;
+    request.writeLen = 1;
+    request.readLen = len;
+    request.data[0] = reg;
+    request.readBuffer = buffer;
+    request.done = done;
+    return submit(request);
+}
+
+bool I2CBusClass::write(uint8_t address, uint8_t reg, const uint8_t *data,
+                        uint8_t len, uint8_t priority, I2CDoneDelegate done)
+{
+    I2CRequest request;
+
+    if (len + 1 > I2C_MAX_DATA)
+        return false;
+
+    request.address = address;
+    request.priority = priority;
+    request.writeLen = len + 1;
+    request.readLen = 0;
+    request.data[0] = reg;
+    request.readBuffer = NULL;
+    memcpy(&request.data[1], data, len);
+    request.done = done;
+    return submit(request);
+}
+
+bool I2CBusClass::submitJob(uint8_t address, uint8_t priority,
+                            I2CJobDelegate job)
+{
+    I2CRequest request;
+
+    request.address = address;
+    request.priority = priority;
+    request.writeLen = 0;
+    request.readLen = 0;
+    request.readBuffer = NULL;
+    request.job = job;
+    return submit(request);
+}
+
+bool I2CBusClass::submit(const I2CRequest &request)
+{
+    if (request.priority != I2C_PRIO_OUTPUT &&
+        I2C_QUEUE_SIZE - queued <= I2C_OUTPUT_RESERVE)
+    {
+        dropped++;
+        return false;
+    }
+
+    for (int i = 0; i < I2C_QUEUE_SIZE; i++)
+    {
+        if (used[i])
+            continue;
+
+        queue[i] = request;
+        queue[i].status = 0;
+        queue[i].seq = seq++;
+        queue[i].queued = micros();
+        used[i] = true;
+        queued++;
+
+        if (!runTimer.isStarted())
+            runTimer.initializeMs(1, TimerDelegate(&I2CBusClass::run, this)).startOnce();
+        return true;
+    }
+
+    dropped++;
+    return false;
+}
+
+/*
+ * Run queued requests, highest priority and oldest first, until the
+ * queue is empty or the time slice is used up. Whatever is left waits
+ * for the next run, so other work gets the CPU in between.
+ */
+void I2CBusClass::run()
+{
+    uint32_t start = micros();
+
+    while (queued > 0 && micros() - start < I2C_SLICE_US)
+    {
+        int next = -1;
+
+        for (int i = 0; i < I2C_QUEUE_SIZE; i++)
+        {
+            if (!used[i])
+                continue;
+            if (next < 0 ||
+                queue[i].priority < queue[next].priority ||
+                (queue[i].priority == queue[next].priority &&
+                 (int32_t)(queue[i].seq - queue[next].seq) < 0))
+                next = i;
+        }
+
+        /* Take it off the queue first, its callback may queue more */
+        I2CRequest request = queue[next];
+        used[next] = false;
+        queued--;
+
+        execute(request);
+    }
+
+    if (queued > 0 && !runTimer.isStarted())
+        runTimer.initializeMs(1, TimerDelegate(&I2CBusClass::run, this)).startOnce();
+}
+
+void I2CBusClass::execute(I2CRequest &request)
+{
+    uint32_t start = micros();
+    uint32_t waitUs = start - request.queued;
+
+    WDT.alive();
+
+    Wire.lock();
+    if (request.job)
+    {
+        request.job();
+    }
+    else
+    {
+        Wire.beginTransmission(request.address);
+        Wire.write(request.data, request.writeLen);
+        request.status = Wire.endTransmission();
+
+        if (request.status == 0 && request.readLen > 0)
+        {
+            if (Wire.requestFrom(request.address, request.readLen) !=
+                request.readLen)
+            {
+                request.status = I2C_ERR_SHORT_READ;
+            }
+            else
+            {
+                uint8_t *dest = request.readBuffer ? request.readBuffer :
+                                                     request.data;
+                for (int i = 0; i < request.readLen; i++)
+                    dest[i] = Wire.read();
+            }
+        }
+    }
+    Wire.unlock();
+
+    account(request.address, micros() - start, waitUs, request.status != 0);
+
+    if (request.done)
+        request.done(request);
+}
+
+I2CDeviceStats *I2CBusClass::getDevice(uint8_t address)
+{
+    for (int i = 0; i < numDevices; i++)
+    {
+        if (devices[i].address == address)
+            return &devices[i];
+    }
+
+    if (numDevices == I2C_MAX_DEVICES)
+        return NULL;
+
+    I2CDeviceStats *device = &devices[numDevices++];
+    memset(device, 0, sizeof(*device));
+    device->address = address;
+    return device;
+}
+
+void I2CBusClass::account(uint8_t address, uint32_t busUs, uint32_t waitUs,
+                          bool error)
+{
+    I2CDeviceStats *device = getDevice(address);
+
+    if (!device)
+        return;
+
+    device->requests++;
+    device->busUs += busUs;
+    device->waitUs += waitUs;
+    if (busUs > device->maxUs)
+        device->maxUs = busUs;
+    if (error)
+        device->errors++;
+}
+
+void I2CBusClass::print(CommandOutput* out)
+{
+    out->printf("device  requests  errors  bus ms  avg us  max us  avg wait us\r\n");
+    for (int i = 0; i < numDevices; i++)
+    {
+        I2CDeviceStats &d = devices[i];
+
+        out->printf("  0x%02x  %8lu  %6lu  %6lu  %6lu  %6lu  %11lu\r\n",
+                    d.address, d.requests, d.errors,
+                    (uint32_t)(d.busUs / 1000),
+                    d.requests ? (uint32_t)(d.busUs / d.requests) : 0,
+                    d.maxUs,
+                    d.requests ? (uint32_t)(d.waitUs / d.requests) : 0);
+    }
+    out->printf("%d requests queued, %lu dropped because the queue was full\r\n",
+                queued, dropped);
+}
+
+void I2CBusClass::reset()
+{
+    numDevices = 0;
+    dropped = 0;
+}
@@ -17,4 +17,121 @@ class MyI2C
     void begin();
 };
 
+/*
+ * I2C bus scheduler. Periodic bus work is queued instead of being done
+ * right away from timers. The queue is run from its own timer, highest
+ * priority first and in order within a priority, a few milliseconds at
+ * a time, so input reads never wait behind a queue of display refreshes.
+ *
+ * A request is either a transfer, bytes written and then read back with
+ * the result passed to a completion callback, or a job for devices that
+ * are driven through a library. Jobs run to completion, so keep them
+ * short: the display draws in RAM first and only queues the transfer.
+ *
+ * Bus time is accounted per device address, including work done outside
+ * the queue such as ATSHA204 signing from the radio path, which runs
+ * between queued requests anyway.
+ */
+/*
+ * One tick of periodic work is at most a GPIO and an INTF read for each
+ * of 7 MCP23017s, a burst for each of 8 PCF8591s, the RTC and the
+ * display: 24 requests. On top of that I2C_OUTPUT_RESERVE slots only
+ * take output writes, so switching a relay never fails because polling
+ * filled the queue.
+ */
+#define I2C_OUTPUT_RESERVE 4
+#define I2C_QUEUE_SIZE   (24 + I2C_OUTPUT_RESERVE)
+#define I2C_MAX_DATA     8     // bytes written or read by a transfer
+#define I2C_MAX_READ     32    // into a buffer of the caller, Wire's limit
+#define I2C_MAX_DEVICES  16    // devices the bus time is kept for
+#define I2C_SLICE_US     2000  // no new request is started after this
+
+#define I2C_ERR_SHORT_READ 5   // after the Wire endTransmission codes
+
+enum I2CPriority
+{
+    I2C_PRIO_INPUT,     // expander inputs
+    I2C_PRIO_OUTPUT,    // expander outputs
+    I2C_PRIO_CLOCK,     // RTC
+    I2C_PRIO_DISPLAY,   // display refresh
+    I2C_PRIORITIES
+};
+
+struct I2CRequest;
+
+typedef Delegate<void(I2CRequest &)> I2CDoneDelegate;
+typedef Delegate<void()> I2CJobDelegate;
+
+struct I2CRequest
+{
+    uint8_t         address;
+    uint8_t         priority;
+    uint8_t         writeLen;
+    uint8_t         readLen;
+    uint8_t         status;              // 0 or an endTransmission error
+    uint8_t         data[I2C_MAX_DATA];  // to write, then what was read
+    uint8_t        *readBuffer;          // read here instead if set
+    uint32_t        seq;                 // order within a priority
+    uint32_t        queued;              // micros() when submitted
+    I2CDoneDelegate done;
+    I2CJobDelegate  job;
+};
+
+typedef struct
+{
+    uint8_t  address;
+    uint32_t requests;
+    uint64_t busUs;                      // total time spent on the bus
+    uint32_t maxUs;
+    uint64_t waitUs;                     // total time spent in the queue
+    uint32_t errors;
+} I2CDeviceStats;
+
+class I2CBusClass
+{
+  public:
+    bool read(uint8_t address, uint8_t reg, uint8_t len, uint8_t priority,
+              I2CDoneDelegate done, uint8_t *buffer = NULL);
+    bool write(uint8_t address, uint8_t reg, const uint8_t *data,
+               uint8_t len, uint8_t priority,
+               I2CDoneDelegate done = NULL);
+    bool submit(const I2CRequest &request);
+    bool submitJob(uint8_t address, uint8_t priority, I2CJobDelegate job);
+
+    void account(uint8_t address, uint32_t busUs, uint32_t waitUs = 0,
+                 bool error = false);
+    void print(CommandOutput* out);
+    void reset();
+
+  private:
+    void run();
+    void execute(I2CRequest &request);
+    I2CDeviceStats *getDevice(uint8_t address);
+
+  private:
+    I2CRequest     queue[I2C_QUEUE_SIZE];
+    bool           used[I2C_QUEUE_SIZE] = { false };
+    uint8_t        queued = 0;
+    uint32_t       seq = 0;
+    uint32_t       dropped = 0;          // queue full
+    Timer          runTimer;
+
+    I2CDeviceStats devices[I2C_MAX_DEVICES];
+    uint8_t        numDevices = 0;
+};
+
+extern I2CBusClass I2CBus;
+
+/* Accounts the rest of the enclosing block as bus time of a device */
+class I2CBusTime
+{
+  public:
+    I2CBusTime(uint8_t address) : address(address), start(micros()) {}
+    ~I2CBusTime() { I2CBus.account(address, micros() - start); }
+
+  private:
+    uint8_t  address;
+    uint32_t start;
+};
+
 #endif //INCLUDE_ICC_H_
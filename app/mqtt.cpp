@@ -6,6 +6,8 @@
 #include <MyGateway.h>
 #include "MyStatus.h"
 #include <HTTP.h>
+#include <Logging.h>
+#include <Perf.h>
 
 // Forward declarations
 void onMessageReceived(String topic, String message);
@@ -18,15 +20,70 @@ bool MqttIsConnected = FALSE;
 
 unsigned long mqttPktRx = 0;
 unsigned long mqttPktTx = 0;
+unsigned long mqttPktDropped = 0;
+unsigned long mqttPublishFlushes = 0;
+unsigned long mqttPublishMaxPerFlush = 0;
+
+/*
+ * Sensor publishes are collected for a few milliseconds and then handed
+ * to the client back to back, so they leave in a single TCP write.
+ */
+#define MQTT_PUBLISH_BATCH_SIZE  16
+#define MQTT_PUBLISH_BATCH_DELAY 10 // ms
+
+typedef struct
+{
+    String topic;
+    String message;
+} mqttPendingPublish;
+
+mqttPendingPublish publishBatch[MQTT_PUBLISH_BATCH_SIZE];
+int publishBatchCount = 0;
+Timer publishBatchTimer;
+String sensorTopicPfx;
+String controllerTopicPfx;
+Vector<String> allowList;
+
+void ICACHE_FLASH_ATTR mqttFlushPublishBatch()
+{
+    int count = publishBatchCount;
+
+    publishBatchTimer.stop();
+    publishBatchCount = 0;
+
+    if (!mqtt || count == 0)
+        return;
+
+    PERF_SCOPE(PERF_MQTT_PUBLISH);
+    for (int i = 0; i < count; i++)
+    {
+        mqtt->publish(publishBatch[i].topic, publishBatch[i].message);
+        publishBatch[i].topic = "";
+        publishBatch[i].message = "";
+    }
+
+    mqttPktTx += count;
+    mqttPublishFlushes++;
+    if (count > mqttPublishMaxPerFlush)
+        mqttPublishMaxPerFlush = count;
+    getStatusObj().updateMqttPackets (0, count);
+}
 
 void ICACHE_FLASH_ATTR mqttPublishMessage(String topic, String message)
 {
     if (!mqtt)
         return;
 
-    mqtt->publish(AppSettings.mqttSensorPfx + String("/") + topic, message);
-    mqttPktTx++;
-    getStatusObj().updateMqttPackets (0, 1);
+    if (publishBatchCount == MQTT_PUBLISH_BATCH_SIZE)
+        mqttFlushPublishBatch();
+
+    publishBatch[publishBatchCount].topic = sensorTopicPfx + topic;
+    publishBatch[publishBatchCount].message = message;
+    publishBatchCount++;
+
+    if (!publishBatchTimer.isStarted())
+        publishBatchTimer.initializeMs(MQTT_PUBLISH_BATCH_DELAY,
+                                       mqttFlushPublishBatch).startOnce();
 }
 
 void ICACHE_FLASH_ATTR mqttPublishVersion()
@@ -39,26 +96,72 @@ void ICACHE_FLASH_ATTR mqttPublishVersion()
 
 // Callback for messages, arrived from MQTT server
 
-String getValue(String data, char separator, int index)
+int updateSensorStateInt(int node, int sensor, int type, int value);
+
+/*
+ * Parses a decimal field terminated by '/', advancing p past the '/'.
+ */
+static bool parseTopicNumber(const char *&p, int &value)
 {
-  int found = 0;
-  int strIndex[] = {0, -1};
-  int maxIndex = data.length()-1;
-
-  for(int i=0; i<=maxIndex && found<=index; i++){
-    if(data.charAt(i)==separator || i==maxIndex){
-        found++;
-        strIndex[0] = strIndex[1]+1;
-        strIndex[1] = (i == maxIndex) ? i+1 : i;
-    }
-  }
+    const char *start = p;
 
-  return found>index ? data.substring(strIndex[0], strIndex[1]) : "";
+    value = 0;
+    while (*p >= '0' && *p <= '9')
+        value = value * 10 + (*p++ - '0');
+
+    if (p == start || *p != '/')
+        return false;
+    p++;
+    return true;
 }
 
-int updateSensorStateInt(int node, int sensor, int type, int value);
-int getTypeFromString(String type);
+/*
+ * Parses "<NODEID>/<SENSOR_ID>/V_<SENSOR_TYPE>" in a single pass over the
+ * topic bytes, without creating any substrings.
+ */
+static bool parseControllerTopic(const char *p, int &node, int &sensor,
+                                 int &type)
+{
+    if (!parseTopicNumber(p, node) || !parseTopicNumber(p, sensor))
+        return false;
+
+    if (p[0] != 'V' || p[1] != '_')
+        return false;
+    p += 2;
+
+    const char *name = p;
+    while (*p && *p != '/')
+        p++;
+
+    type = MyGateway::getSensorTypeFromString(name, p - name);
+    return type != 255;
+}
+
+/*
+ * Matches a topic against a subscription filter with MQTT '+' and '#'
+ * wildcards.
+ */
+static bool mqttTopicMatches(const char *filter, const char *topic)
+{
+    while (*filter)
+    {
+        if (*filter == '#')
+            return true;
+
+        if (*filter == '+')
+        {
+            while (*topic && *topic != '/')
+                topic++;
+            filter++;
+            continue;
+        }
 
+        if (*filter++ != *topic++)
+            return false;
+    }
+
+    return *topic == 0;
+}
 
 void ICACHE_FLASH_ATTR onMessageReceived(String topic, String message)
 {
@@ -67,55 +170,84 @@ void ICACHE_FLASH_ATTR onMessageReceived(String topic, String message)
      *   /? => send version info
      *   <MQTTPREFIX>/<NODEID>/<SENSOR_ID>/<SENSOR_TYPE>/<VALUE>
      */
+    const char *t = topic.c_str();
+    int node, sensor, type;
+
+    if (topic.equals("/?"))
+    {
+        mqttPublishVersion();
+        return;
+    }
 
     //MyMQTT/22/1/V_LIGHT
-    if (topic.startsWith(AppSettings.mqttControllerPfx + "/"))
+    if (strncmp(t, controllerTopicPfx.c_str(), controllerTopicPfx.length()) != 0)
     {
-        mqttPktRx++;
-        getStatusObj().updateMqttPackets (1, 0);
-
-        String node   = getValue(topic, '/', 1);
-        String sensor = getValue(topic, '/', 2);
-        String type   = getValue(topic, '/', 3);
-        Debug.println();
-        Debug.println();
-        Debug.println();
-        Debug.println(node);
-        Debug.println(sensor);
-        Debug.println(type);
-        Debug.println(message);
-        //strip leading V_
-        type.remove(0,2);
-        Debug.println(MyGateway::getSensorTypeFromString(type));
-
-        updateSensorStateInt(node.toInt(), sensor.toInt(),
-                             MyGateway::getSensorTypeFromString(type),
-                             message.toInt());
+        for (int i = 0; i < allowList.count(); i++)
+        {
+            if (mqttTopicMatches(allowList[i].c_str(), t))
+            {
+                mqttPktRx++;
+                getStatusObj().updateMqttPackets (1, 0);
+                LOG(MQTT, LOG_DEBUG, "RX: %s = %s", t, message.c_str());
+                return;
+            }
+        }
+
+        /* Only reaches us through an overlapping subscription */
+        mqttPktDropped++;
+        return;
     }
 
-    if (topic.equals(String("/?")))
+    mqttPktRx++;
+    getStatusObj().updateMqttPackets (1, 0);
+
+    if (!parseControllerTopic(t + controllerTopicPfx.length(),
+                              node, sensor, type))
     {
-        mqttPublishVersion();
+        LOG(MQTT, LOG_WARN, "MQTT: ignoring topic %s", t);
         return;
     }
 
-    Debug.println("RX: " + topic + " = " + message);
+    updateSensorStateInt(node, sensor, type, message.toInt());
 }
 
 // Run MQTT client
 void ICACHE_FLASH_ATTR startMqttClient()
 {
     if (mqtt)
+    {
         delete mqtt;
+        mqtt = NULL;
+    }
 
     AppSettings.load();
+    sensorTopicPfx = AppSettings.mqttSensorPfx + "/";
+    controllerTopicPfx = AppSettings.mqttControllerPfx + "/";
+
+    Vector<String> entries;
+    allowList.clear();
+    splitString(AppSettings.mqttAllowList, ',', entries);
+    for (int i = 0; i < entries.count(); i++)
+    {
+        entries[i].trim();
+        if (entries[i].length() > 0)
+            allowList.add(entries[i]);
+    }
     if (!AppSettings.mqttServer.equals(String("")) && AppSettings.mqttPort != 0)
     {
         getStatusObj().updateMqttConnection (AppSettings.mqttServer, "Connecting...");
         sprintf(clientId, "ESP_%08X", system_get_chip_id());
         mqtt = new MqttClient(AppSettings.mqttServer, AppSettings.mqttPort, onMessageReceived);
         MqttIsConnected = mqtt->connect(clientId, AppSettings.mqttUser, AppSettings.mqttPass);
-        mqtt->subscribe("#");
+
+        /*
+         * Let the broker do the filtering: only controller commands, the
+         * version query and explicitly allowed topics are delivered.
+         */
+        mqtt->subscribe(controllerTopicPfx + "+/+/+");
+        mqtt->subscribe("/?");
+        for (int i = 0; i < allowList.count(); i++)
+            mqtt->subscribe(allowList[i]);
         if (mqtt->getConnectionState() == eTCS_Connected)
         {
           getStatusObj().updateMqttConnection (AppSettings.mqttServer, "Connected");
@@ -153,6 +285,7 @@ void onMqttConfig(HttpRequest &request, HttpResponse &response)
         AppSettings.mqttPort = atoi(request.getPostParameter("port").c_str());
         AppSettings.mqttSensorPfx = request.getPostParameter("sensorPfx");
         AppSettings.mqttControllerPfx = request.getPostParameter("controllerPfx");
+        AppSettings.mqttAllowList = request.getPostParameter("allowList");
 
         AppSettings.save();
         if (AppSettings.wired || WifiStation.isConnected())
@@ -168,6 +301,7 @@ void onMqttConfig(HttpRequest &request, HttpResponse &response)
     vars["port"] = AppSettings.mqttPort;
     vars["sensorPfx"] = AppSettings.mqttSensorPfx;
     vars["controllerPfx"] = AppSettings.mqttControllerPfx;
+    vars["allowList"] = AppSettings.mqttAllowList;
     response.sendTemplate(tmpl); // will be automatically deleted
 }
 
@@ -4,6 +4,7 @@
 void ICACHE_FLASH_ATTR startMqttClient();
 void ICACHE_FLASH_ATTR checkMqttClient();
 void ICACHE_FLASH_ATTR mqttPublishMessage(String topic, String message);
+void ICACHE_FLASH_ATTR mqttFlushPublishBatch();
 void ICACHE_FLASH_ATTR mqttRegisterHttpHandlers(HttpServer &server);
 
 bool isMqttConfigured();
@@ -12,5 +13,8 @@ String MqttServer();
 
 extern unsigned long mqttPktRx;
 extern unsigned long mqttPktTx;
+extern unsigned long mqttPktDropped;
+extern unsigned long mqttPublishFlushes;
+extern unsigned long mqttPublishMaxPerFlush;
 
 #endif //MY_SENSORS_GW_MQTT_H
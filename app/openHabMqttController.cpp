@@ -13,6 +13,7 @@ void OpenHabMqttController::begin()
         1000,
         TimerDelegate(&OpenHabMqttController::checkConnection,
 	              this)).start(true);
+    subscribeEvents();
 }
 
 void OpenHabMqttController::notifyChange(String object, String value)
@@ -4,6 +4,7 @@
 #include <AppSettings.h>
 #include <mqtt.h>
 #include "MyStatus.h"
+#include "MySensors/MyHwESP8266.h"
 
 /*******/
 /* OTA */
@@ -82,6 +83,7 @@ void otaUpdate_CallBack(bool result) {
         // set to boot new rom and then reboot
         Debug.printf("Firmware updated, rebooting to rom %d...\r\n", slot);
         rboot_set_current_rom(slot);
+        hw_commitConfig();
         System.restart();
     }
     else
@@ -42,21 +42,221 @@ ISR (WDT_vect)
 }
 */
 
-char *configBlock = NULL;
+/*
+ * Persistent config store
+ *
+ * The config block (what the EEPROM is on an ATMega328) is kept in RAM and
+ * written back to flash in batches from a timer. Flash is used as a log:
+ * every sector starts with a full snapshot of the block, followed by one
+ * 4 byte record per byte changed since. When the active sector is full the
+ * next one is erased and started with a fresh snapshot, so erases rotate
+ * over all sectors. The header is written last, so a sector only becomes
+ * valid once its snapshot is complete.
+ */
+#define CONFIG_BLOCK_SIZE          1024 /*ATMega328 has 1024 bytes*/
+#define CONFIG_STORE_FIRST_SECTOR  0x1FC /* 0x1FC000, below rom slot 1 */
+#define CONFIG_STORE_SECTORS       4
+#define CONFIG_STORE_MAGIC         0x4643594D /* "MYCF" */
+#define CONFIG_STORE_COMMIT_DELAY  2000 /* ms */
+#define CONFIG_STORE_SNAPSHOT_OFFS 16
+#define CONFIG_STORE_LOG_OFFS      (CONFIG_STORE_SNAPSHOT_OFFS + CONFIG_BLOCK_SIZE)
+#define CONFIG_STORE_RECORD_EMPTY  0xFFFFFFFF
+
+typedef struct
+{
+  uint32_t magic;
+  uint32_t sequence;
+  uint32_t checksum; /* of the snapshot */
+  uint32_t reserved;
+} ConfigSectorHeader;
+
+static uint32_t configWords[CONFIG_BLOCK_SIZE / 4];
+static uint8_t *configBlock = (uint8_t *)configWords;
+static uint8_t configDirty[CONFIG_BLOCK_SIZE / 8];
+static bool configHasDirty = false;
+static int configSector = -1;
+static uint32_t configSequence = 0;
+static uint32_t configLogPos = 0;
+static Timer configCommitTimer;
+
+static inline uint32_t hw_configSectorAddr(int sector)
+{
+  return (CONFIG_STORE_FIRST_SECTOR + sector) * SPI_FLASH_SEC_SIZE;
+}
 
-static void hw_initConfigBlock( size_t length = 1024 /*ATMega328 has 1024 bytes*/ )
+static uint32_t hw_configChecksum()
 {
-  static bool initDone = false;
-  if (!initDone)
+  uint32_t sum = 0x811C9DC5;
+  for (int i = 0; i < CONFIG_BLOCK_SIZE / 4; i++)
+    sum = (sum ^ configWords[i]) * 16777619;
+  return sum;
+}
+
+static inline uint8_t hw_configRecordCheck(uint16_t offs, uint8_t value)
+{
+  return (offs ^ (offs >> 8) ^ value ^ 0x5A) & 0xff;
+}
+
+static inline uint32_t hw_configRecord(uint16_t offs, uint8_t value)
+{
+  return ((uint32_t)offs << 16) | ((uint32_t)value << 8) |
+         hw_configRecordCheck(offs, value);
+}
+
+/* Replays the change records of the active sector into the RAM block */
+static void hw_replayConfigLog()
+{
+  uint32_t records[32];
+  uint32_t addr = hw_configSectorAddr(configSector);
+
+  configLogPos = CONFIG_STORE_LOG_OFFS;
+  while (configLogPos < SPI_FLASH_SEC_SIZE)
+  {
+    uint32_t len = min((uint32_t)sizeof(records),
+                       (uint32_t)(SPI_FLASH_SEC_SIZE - configLogPos));
+    spi_flash_read(addr + configLogPos, records, len);
+
+    for (int i = 0; i < len / 4; i++)
+    {
+      uint32_t r = records[i];
+      if (r == CONFIG_STORE_RECORD_EMPTY)
+        return;
+
+      uint16_t offs = r >> 16;
+      uint8_t value = (r >> 8) & 0xff;
+      /* A record torn by a reset fails the check and is skipped */
+      if (offs < CONFIG_BLOCK_SIZE &&
+          (r & 0xff) == hw_configRecordCheck(offs, value))
+        configBlock[offs] = value;
+      configLogPos += 4;
+    }
+  }
+}
+
+static bool hw_loadConfigSector(int sector)
+{
+  ConfigSectorHeader hdr;
+  uint32_t addr = hw_configSectorAddr(sector);
+
+  spi_flash_read(addr, (uint32_t *)&hdr, sizeof(hdr));
+  if (hdr.magic != CONFIG_STORE_MAGIC)
+    return false;
+
+  spi_flash_read(addr + CONFIG_STORE_SNAPSHOT_OFFS, configWords,
+                 CONFIG_BLOCK_SIZE);
+  if (hw_configChecksum() != hdr.checksum)
+    return false;
+
+  configSector = sector;
+  configSequence = hdr.sequence;
+  hw_replayConfigLog();
+  return true;
+}
+
+/* Erases the next sector and writes a snapshot of the RAM block to it */
+static void hw_startConfigSector()
+{
+  ConfigSectorHeader hdr;
+  int sector = (configSector + 1) % CONFIG_STORE_SECTORS;
+  uint32_t addr = hw_configSectorAddr(sector);
+
+  spi_flash_erase_sector(CONFIG_STORE_FIRST_SECTOR + sector);
+  spi_flash_write(addr + CONFIG_STORE_SNAPSHOT_OFFS, configWords,
+                  CONFIG_BLOCK_SIZE);
+
+  hdr.magic = CONFIG_STORE_MAGIC;
+  hdr.sequence = configSequence + 1;
+  hdr.checksum = hw_configChecksum();
+  hdr.reserved = 0xffffffff;
+  spi_flash_write(addr, (uint32_t *)&hdr, sizeof(hdr));
+
+  configSector = sector;
+  configSequence = hdr.sequence;
+  configLogPos = CONFIG_STORE_LOG_OFFS;
+}
+
+void hw_commitConfig()
+{
+  uint32_t records[32];
+  int numRecords = 0;
+
+  configCommitTimer.stop();
+  if (!configHasDirty)
+    return;
+
+  for (int offs = 0; offs < CONFIG_BLOCK_SIZE; offs++)
   {
-    //EEPROM.begin(length);
-    //initDone = true;
+    if (!(configDirty[offs / 8] & (1 << (offs % 8))))
+      continue;
+
+    /* No room left for what is pending: a new snapshot covers it all */
+    if (configSector < 0 ||
+        configLogPos + (numRecords + 1) * 4 > SPI_FLASH_SEC_SIZE)
+    {
+      hw_startConfigSector();
+      numRecords = 0;
+      break;
+    }
+
+    records[numRecords++] = hw_configRecord(offs, configBlock[offs]);
+    if (numRecords == sizeof(records) / 4)
+    {
+      spi_flash_write(hw_configSectorAddr(configSector) + configLogPos,
+                      records, sizeof(records));
+      configLogPos += sizeof(records);
+      numRecords = 0;
+    }
+  }
 
-    configBlock = (char *)malloc(length);
-    if (configBlock != NULL)
-        memset(configBlock, 0xff, length);
-    initDone = (configBlock != NULL);
+  if (numRecords > 0)
+  {
+    spi_flash_write(hw_configSectorAddr(configSector) + configLogPos,
+                    records, numRecords * 4);
+    configLogPos += numRecords * 4;
   }
+
+  memset(configDirty, 0, sizeof(configDirty));
+  configHasDirty = false;
+}
+
+static void hw_initConfigBlock()
+{
+  static bool initDone = false;
+  if (initDone)
+    return;
+  initDone = true;
+
+  /* Restore from the valid sector with the highest sequence number */
+  bool tried[CONFIG_STORE_SECTORS] = { false };
+  for (int attempt = 0; attempt < CONFIG_STORE_SECTORS; attempt++)
+  {
+    ConfigSectorHeader hdr;
+    int best = -1;
+    uint32_t bestSequence = 0;
+
+    for (int s = 0; s < CONFIG_STORE_SECTORS; s++)
+    {
+      if (tried[s])
+        continue;
+      spi_flash_read(hw_configSectorAddr(s), (uint32_t *)&hdr, sizeof(hdr));
+      if (hdr.magic == CONFIG_STORE_MAGIC &&
+          (best < 0 || hdr.sequence > bestSequence))
+      {
+        best = s;
+        bestSequence = hdr.sequence;
+      }
+    }
+
+    if (best < 0)
+      break;
+    tried[best] = true;
+    if (hw_loadConfigSector(best))
+      return;
+  }
+
+  /* Nothing stored yet, start as an erased EEPROM */
+  configSector = -1;
+  memset(configWords, 0xff, sizeof(configWords));
 }
 
 void hw_readConfigBlock(void* buf, void* adr, size_t length)
@@ -66,9 +266,7 @@ void hw_readConfigBlock(void* buf, void* adr, size_t length)
   int offs = reinterpret_cast<int>(adr);
   while (length-- > 0)
   {
-    //*dst++ = EEPROM.read(offs++); 
     *dst++ = configBlock[offs++]; 
-    *dst++ = 0;
   }
 }
 
@@ -79,10 +277,19 @@ void hw_writeConfigBlock(void* buf, void* adr, size_t length)
   int offs = reinterpret_cast<int>(adr);
   while (length-- > 0)
   {
-    //EEPROM.write(offs++, *src++);
-    configBlock[offs++] = *src++;
+    if (configBlock[offs] != *src)
+    {
+      configBlock[offs] = *src;
+      configDirty[offs / 8] |= 1 << (offs % 8);
+      configHasDirty = true;
+    }
+    offs++;
+    src++;
   }
-  //EEPROM.commit();
+
+  if (configHasDirty && !configCommitTimer.isStarted())
+    configCommitTimer.initializeMs(CONFIG_STORE_COMMIT_DELAY,
+                                   hw_commitConfig).startOnce();
 }
 
 uint8_t hw_readConfig(int adr)
@@ -36,13 +36,14 @@
 #define hw_digitalWrite(__pin, __value) (digitalWrite(__pin, __value))
 #define hw_init() Serial.begin(BAUD_RATE)
 #define hw_watchdogReset() WDT.alive()
-#define hw_reboot() System.restart()
+#define hw_reboot() do { hw_commitConfig(); System.restart(); } while (0)
 #define hw_millis() millis()
 
 void hw_readConfigBlock(void* buf, void* adr, size_t length);
 void hw_writeConfigBlock(void* buf, void* adr, size_t length);
 void hw_writeConfig(int adr, uint8_t value);
 uint8_t hw_readConfig(int adr);
+void hw_commitConfig();
 
 enum period_t
 {
@@ -21,6 +21,7 @@
 #include "MyMessage.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 char *utoa(unsigned num, char *str, int radix) {
     char temp[17];  //an int can only be 16 bits long
@@ -108,6 +109,74 @@ char* MyMessage::getStream(char *buffer) const {
 	}
 }
 
+// Fixed point rendering of a float, the same text as dtostrf(value, 2,
+// decimals) without going through double arithmetic. The float is
+// mantissa * 2^exponent, so value * 10^decimals is rounded exactly in
+// 64 bit integers, half away from zero like dtostrf. Values whose integer
+// part doesn't fit 32 bits (or nan/inf) still take dtostrf.
+static char* floatToString(float value, uint8_t decimals, char *buffer) {
+	static const uint32_t scale[] = {
+		1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+	};
+	float absValue = value < 0 ? -value : value;
+
+	if (decimals > 9 || !(absValue < 4294967040.0f)) {
+		return dtostrf(value, 2, decimals, buffer);
+	}
+
+	uint32_t bits;
+	memcpy(&bits, &absValue, sizeof(bits));
+	uint32_t biased = (bits >> 23) & 0xff;
+	uint64_t mantissa = bits & 0x7fffff;
+	int shift; // value = mantissa / 2^shift
+	if (biased) {
+		mantissa |= 0x800000;
+		shift = 150 - biased;
+	} else {
+		shift = 149; // denormal
+	}
+
+	uint64_t scaled; // value * 10^decimals, rounded
+	if (shift <= 0) {
+		scaled = (mantissa << -shift) * scale[decimals];
+	} else if (shift < 64) {
+		scaled = (mantissa * scale[decimals] + (1ULL << (shift - 1))) >> shift;
+	} else {
+		scaled = 0; // below 2^-40, rounds to zero at any precision
+	}
+	uint32_t whole = scaled / scale[decimals];
+	uint32_t frac = scaled % scale[decimals];
+
+	char digits[10];
+	uint8_t numDigits = 0;
+	do {
+		digits[numDigits++] = '0' + whole % 10;
+		whole /= 10;
+	} while (whole);
+
+	char *p = buffer;
+	bool negative = value < 0;
+	if (negative + numDigits + (decimals ? decimals + 1 : 0) < 2) {
+		*p++ = ' '; // dtostrf's minimum width
+	}
+	if (negative) {
+		*p++ = '-';
+	}
+	while (numDigits) {
+		*p++ = digits[--numDigits];
+	}
+	if (decimals) {
+		*p++ = '.';
+		for (uint8_t i = decimals; i > 0; i--) {
+			p[i - 1] = '0' + frac % 10;
+			frac /= 10;
+		}
+		p += decimals;
+	}
+	*p = 0;
+	return buffer;
+}
+
 char* MyMessage::getString(char *buffer) const {
 	uint8_t payloadType = miGetPayloadType();
 	if (buffer != NULL) {
@@ -125,7 +194,7 @@ char* MyMessage::getString(char *buffer) const {
 		} else if (payloadType == P_ULONG32) {
 			ultoa(ulValue, buffer, 10);
 		} else if (payloadType == P_FLOAT32) {
-			dtostrf(fValue,2,fPrecision,buffer);
+			floatToString(fValue,fPrecision,buffer);
 		} else if (payloadType == P_CUSTOM) {
 			return getCustomString(buffer);
 		}
@@ -22,6 +22,16 @@
 
 #define DISTANCE_INVALID (0xFF)
 
+void __attribute__((weak)) myPacketHook(uint8_t event, const MyMessage &message, uint8_t to, bool ok) {
+}
+
+uint32_t __attribute__((weak)) myStageStartHook(uint8_t stage) {
+	return 0;
+}
+
+void __attribute__((weak)) myStageEndHook(uint8_t stage, uint32_t start) {
+}
+
 #ifdef MY_SIGNING_FEATURE
 // Macros for manipulating signing requirement table
 #define DO_SIGN(node) (~doSign[node>>3]&(1<<(node%8)))
@@ -68,7 +78,8 @@ MySensor::MySensor(MyTransport &_radio, MyHw &_hw
 #ifdef MY_OTA_FIRMWARE_FEATURE
  	flash(MY_OTA_FLASH_SS, MY_OTA_FLASH_JDECID),
 #endif
-	hw(_hw)
+	hw(_hw),
+	rxPayloadValid(false)
 {
 }
 
@@ -486,17 +497,19 @@ boolean MySensor::sendRoute(MyMessage &message) {
 }
 
 boolean MySensor::sendWrite(uint8_t to, MyMessage &message) {
+	if (&message == &msg)
+		rxPayloadValid = false; // the received message is being reused
 	mSetVersion(message, PROTOCOL_VERSION);
 	uint8_t length = mGetSigned(message) ? MAX_MESSAGE_LENGTH : mGetLength(message);
 	message.last = nc.nodeId;
 #ifdef WITH_LEDS_BLINKING
 	txBlink(1);
 #endif
+	uint32_t start = myStageStartHook(MY_STAGE_RADIO_TX);
 	bool ok = radio.send(to, &message, min(MAX_MESSAGE_LENGTH, HEADER_SIZE + length));
+	myStageEndHook(MY_STAGE_RADIO_TX, start);
 
-	debugf("send: %d-%d-%d-%d s=%d,c=%d,t=%d,pt=%d,l=%d,sg=%d,st=%s:%s\n",
-			message.sender,message.last, to, message.destination, message.sensor, mGetCommand(message), message.type,
-			mGetPayloadType(message), mGetLength(message), mGetSigned(message), to==BROADCAST_ADDRESS ? "bc" : (ok ? "ok":"fail"), message.getString(convBuf));
+	myPacketHook(MY_PACKET_SENT, message, to, ok);
 
 	return ok;
 }
@@ -574,8 +587,11 @@ boolean MySensor::process() {
 	(void)signer.checkTimer(); // Manage signing timeout
 #endif
 
+	uint32_t start = myStageStartHook(MY_STAGE_RADIO_RX);
 	uint8_t len = radio.receive((uint8_t *)&msg);
+	myStageEndHook(MY_STAGE_RADIO_RX, start);
 	(void)len; //until somebody makes use of 'len'
+	rxPayloadValid = false;
 #ifdef WITH_LEDS_BLINKING
 	rxBlink(1);
 #endif
@@ -607,15 +623,12 @@ boolean MySensor::process() {
 #endif
 
 	if (msg.destination == nc.nodeId) {
-		debugf("read: %d-%d-%d s=%d,c=%d,t=%d,pt=%d,l=%d,sg=%d:%s\n",
-			msg.sender, msg.last, msg.destination, msg.sensor, mGetCommand(msg), msg.type, mGetPayloadType(msg), mGetLength(msg), mGetSigned(msg), msg.getString(convBuf));
+		myPacketHook(MY_PACKET_READ, msg, 0, true);
 	} else {
 		if (repeaterMode && nc.nodeId != AUTO) {
-			debugf("read and forward: %d-%d-%d s=%d,c=%d,t=%d,pt=%d,l=%d,sg=%d:%s\n",
-				msg.sender, msg.last, msg.destination, msg.sensor, mGetCommand(msg), msg.type, mGetPayloadType(msg), mGetLength(msg), mGetSigned(msg), msg.getString(convBuf));
+			myPacketHook(MY_PACKET_FORWARD, msg, 0, true);
 		} else {
-			debugf("read and drop: %d-%d-%d s=%d,c=%d,t=%d,pt=%d,l=%d,sg=%d:%s\n",
-				msg.sender, msg.last, msg.destination, msg.sensor, mGetCommand(msg), msg.type, mGetPayloadType(msg), mGetLength(msg), mGetSigned(msg), msg.getString(convBuf));
+			myPacketHook(MY_PACKET_DROP, msg, 0, true);
 		}
 	}
 
@@ -857,6 +870,18 @@ MyMessage& MySensor::getLastMessage() {
 	return msg;
 }
 
+const char* MySensor::getPayloadString(const MyMessage &message) {
+	if (&message != &msg) {
+		rxPayloadValid = false;
+		return message.getString(rxPayload);
+	}
+	if (!rxPayloadValid) {
+		msg.getString(rxPayload);
+		rxPayloadValid = true;
+	}
+	return rxPayload;
+}
+
 void MySensor::saveState(uint8_t pos, uint8_t value) {
 	hw_writeConfig(EEPROM_LOCAL_CONFIG_ADDRESS+pos, value);
 }
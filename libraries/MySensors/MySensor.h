@@ -49,6 +49,24 @@ typedef MyHwESP8266 MyHwDriver;
 typedef Delegate<void(const MyMessage &)> msgRxDelegate;
 #endif
 
+// Application hooks. The library defines them weak and empty, an application
+// that wants to log the packets passing through defines its own.
+#define MY_PACKET_SENT    0 // sendWrite() handed the message to the radio
+#define MY_PACKET_READ    1 // process() read a message addressed to this node
+#define MY_PACKET_FORWARD 2 // ... one to relay
+#define MY_PACKET_DROP    3 // ... one that is neither
+
+// 'to' and 'ok' are only set for MY_PACKET_SENT
+void myPacketHook(uint8_t event, const MyMessage &message, uint8_t to, bool ok);
+
+// Called around the radio transfers, to time them. What the start hook
+// returns is passed to the end hook.
+#define MY_STAGE_RADIO_RX 0
+#define MY_STAGE_RADIO_TX 1
+
+uint32_t myStageStartHook(uint8_t stage);
+void myStageEndHook(uint8_t stage, uint32_t start);
+
 #ifdef DEBUG
 #define debug(x,...) hw.debugPrint(isGateway, x, ##__VA_ARGS__)
 #else
@@ -282,6 +300,14 @@ class MySensor
 	*/
 	MyMessage& getLastMessage(void);
 
+	/**
+	* Returns the payload of a message as text. For the last received
+	* message it is formatted at most once, however many handlers ask.
+	* Other messages are formatted again on every call. The text is valid
+	* until the next call for another message or the next receive.
+	*/
+	const char* getPayloadString(const MyMessage &message);
+
 
 
 	/**
@@ -381,6 +407,8 @@ class MySensor
 #ifdef DEBUG
 	char convBuf[MAX_PAYLOAD*2+1];
 #endif
+	char rxPayload[MAX_PAYLOAD*2+1]; // getPayloadString() of msg
+	bool rxPayloadValid;
 	uint8_t failedTransmissions;
     void (*timeCallback)(unsigned long); // Callback for requested time messages
 #ifndef USE_DELEGATES
@@ -0,0 +1,227 @@
+// Host check of MyMessage::getString() for every payload type against the
+// printf rendering, plus how long each conversion takes. The float cases
+// hold floatToString() to dtostrf(value, 2, decimals): the same digits as
+// printf, except that an exact tie rounds away from zero.
+//
+// The host is LP64, so only values that fit the 32 bit types of the ESP
+// are used.
+
+#include "MyMessage.h"
+#include <math.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define FLOAT_CASES   200000
+#define TIMING_ROUNDS 1000000
+
+static int failures = 0;
+
+static void check(const char *what, const char *got, const char *expected) {
+	if (strcmp(got, expected) != 0) {
+		if (failures < 20) {
+			printf("FAIL %s: got \"%s\", expected \"%s\"\n", what, got, expected);
+		}
+		failures++;
+	}
+}
+
+// Same xorshift for every run, so a failure can be reproduced
+static uint32_t nextRandom() {
+	static uint32_t state = 2463534242u;
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// dtostrf(value, 2, decimals). The float times 10^decimals is exact in a
+// long double, which tells the ties printf would round to even.
+static void referenceFloat(float value, uint8_t decimals, char *out) {
+	long double scaled = fabsl((long double)value) * powl(10, decimals);
+
+	if (scaled - floorl(scaled) != 0.5L) {
+		sprintf(out, "%2.*f", decimals, value);
+		return;
+	}
+
+	uint64_t rounded = (uint64_t)floorl(scaled) + 1;
+	uint64_t scale = (uint64_t)powl(10, decimals);
+	char text[48];
+	if (decimals) {
+		sprintf(text, "%s%llu.%0*llu", value < 0 ? "-" : "",
+		        (unsigned long long)(rounded / scale), decimals,
+		        (unsigned long long)(rounded % scale));
+	} else {
+		sprintf(text, "%s%llu", value < 0 ? "-" : "",
+		        (unsigned long long)rounded);
+	}
+	sprintf(out, "%2s", text);
+}
+
+static void testString() {
+	MyMessage msg;
+	char buffer[MAX_PAYLOAD * 2 + 1];
+
+	check("P_STRING", msg.set("").getString(buffer), "");
+	check("P_STRING", msg.set("22.5").getString(buffer), "22.5");
+	// longer than a payload, cut at MAX_PAYLOAD
+	check("P_STRING", msg.set("0123456789abcdefghijklmnopqrstuvwxyz").getString(buffer),
+	      "0123456789abcdefghijklmno");
+}
+
+static void testIntegers() {
+	MyMessage msg;
+	char buffer[MAX_PAYLOAD * 2 + 1];
+	char expected[16];
+
+	for (int i = 0; i < 256; i++) {
+		sprintf(expected, "%d", i);
+		check("P_BYTE", msg.set((uint8_t)i).getString(buffer), expected);
+	}
+
+	static const long edges[] = {
+		0, 1, -1, 9, 10, -10, 32767, -32768, 65535, 99999, -100000,
+		2147483647L, -2147483647L - 1
+	};
+	for (unsigned i = 0; i < sizeof(edges) / sizeof(edges[0]); i++) {
+		long value = edges[i];
+
+		sprintf(expected, "%ld", value);
+		check("P_INT16", msg.set((int)value).getString(buffer), expected);
+		check("P_LONG32", msg.set(value).getString(buffer), expected);
+		sprintf(expected, "%u", (unsigned)value);
+		check("P_UINT16", msg.set((unsigned)value).getString(buffer), expected);
+		check("P_ULONG32", msg.set((unsigned long)(uint32_t)value).getString(buffer),
+		      expected);
+	}
+
+	for (int i = 0; i < 100000; i++) {
+		uint32_t bits = nextRandom() >> (nextRandom() % 32);
+		int32_t value = (nextRandom() & 1) ? -(int32_t)(bits >> 1) : (int32_t)bits;
+
+		sprintf(expected, "%d", (int)value);
+		check("P_INT16", msg.set((int)value).getString(buffer), expected);
+		check("P_LONG32", msg.set((long)value).getString(buffer), expected);
+		sprintf(expected, "%u", (unsigned)bits);
+		check("P_UINT16", msg.set((unsigned)bits).getString(buffer), expected);
+		check("P_ULONG32", msg.set((unsigned long)bits).getString(buffer), expected);
+	}
+}
+
+static void testCustom() {
+	MyMessage msg;
+	char buffer[MAX_PAYLOAD * 2 + 1];
+	uint8_t payload[MAX_PAYLOAD];
+	char expected[MAX_PAYLOAD * 2 + 1];
+
+	for (int length = 0; length <= MAX_PAYLOAD; length++) {
+		for (int i = 0; i < length; i++) {
+			payload[i] = nextRandom();
+			sprintf(expected + i * 2, "%02X", payload[i]);
+		}
+		expected[length * 2] = 0;
+		check("P_CUSTOM", msg.set(payload, length).getString(buffer), expected);
+	}
+}
+
+static void testFloat() {
+	static const struct {
+		float value;
+		uint8_t decimals;
+		const char *expected;
+	} fixed[] = {
+		{0.005f, 2, "0.00"},     // 0.00499999989, was "0.01" with + 0.5f
+		{0.015f, 2, "0.01"},     // 0.0149999997
+		{0.125f, 2, "0.13"},     // exact tie, away from zero
+		{-0.125f, 2, "-0.13"},
+		{2.5f, 0, " 3"},
+		{0.0f, 0, " 0"},
+		{21.75f, 1, "21.8"},
+		{-3.0f, 2, "-3.00"},
+		{1e-30f, 3, "0.000"},
+		{4294967040.0f, 1, "4294967040.0"}, // first value left to dtostrf
+	};
+	MyMessage msg;
+	char buffer[MAX_PAYLOAD * 2 + 1];
+	char expected[MAX_PAYLOAD * 2 + 1];
+
+	for (unsigned i = 0; i < sizeof(fixed) / sizeof(fixed[0]); i++) {
+		check("P_FLOAT32", msg.set(fixed[i].value, fixed[i].decimals).getString(buffer),
+		      fixed[i].expected);
+	}
+
+	for (int i = 0; i < FLOAT_CASES; i++) {
+		uint32_t bits = nextRandom();
+		float value;
+		uint8_t decimals = nextRandom() % 10;
+		char what[64];
+
+		memcpy(&value, &bits, sizeof(value));
+		// -0 prints as "-0" with printf but "0" here, as on the ESP;
+		// from 4294967040 on it is dtostrf itself
+		if (isnan(value) || !(fabsf(value) < 4294967040.0f) || value == 0) {
+			continue;
+		}
+		referenceFloat(value, decimals, expected);
+		sprintf(what, "P_FLOAT32 %.9g/%d", value, decimals);
+		check(what, msg.set(value, decimals).getString(buffer), expected);
+	}
+}
+
+static void timeGetString(const char *name, const MyMessage &msg) {
+	char buffer[MAX_PAYLOAD * 2 + 1];
+	volatile char sink = 0;
+
+	double start = now();
+	for (int i = 0; i < TIMING_ROUNDS; i++) {
+		sink += msg.getString(buffer)[0];
+	}
+	double elapsed = now() - start;
+	printf("  %-10s %7.1f ns\n", name, elapsed * 1e9 / TIMING_ROUNDS);
+}
+
+static void timeConversions() {
+	MyMessage msg;
+	uint8_t payload[MAX_PAYLOAD];
+	char buffer[MAX_PAYLOAD * 2 + 1];
+	volatile char sink = 0;
+
+	memset(payload, 0xa5, sizeof(payload));
+	printf("getString() per call:\n");
+	timeGetString("P_STRING", msg.set("22.5"));
+	timeGetString("P_BYTE", msg.set((uint8_t)200));
+	timeGetString("P_INT16", msg.set(-12345));
+	timeGetString("P_UINT16", msg.set(54321u));
+	timeGetString("P_LONG32", msg.set(-123456789L));
+	timeGetString("P_ULONG32", msg.set(3123456789UL));
+	timeGetString("P_CUSTOM", msg.set(payload, MAX_PAYLOAD));
+	timeGetString("P_FLOAT32", msg.set(21.37f, 2));
+
+	double start = now();
+	for (int i = 0; i < TIMING_ROUNDS; i++) {
+		sink += dtostrf(21.37f, 2, 2, buffer)[0];
+	}
+	double elapsed = now() - start;
+	printf("  %-10s %7.1f ns\n", "dtostrf", elapsed * 1e9 / TIMING_ROUNDS);
+}
+
+int main() {
+	testString();
+	testIntegers();
+	testCustom();
+	testFloat();
+	timeConversions();
+
+	if (failures) {
+		printf("%d mismatches\n", failures);
+		return 1;
+	}
+	printf("All conversions match\n");
+	return 0;
+}
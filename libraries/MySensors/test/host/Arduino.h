@@ -0,0 +1,39 @@
+// Just enough of the Arduino core to build MyMessage.cpp on the host.
+// The conversions behave like the AVR/Sming ones for the values the
+// test uses; dtostrf is the reference the float rendering is held to.
+
+#ifndef HostArduino_h
+#define HostArduino_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// A function, libstdc++ undefines a min macro
+template <typename T, typename U>
+static inline T min(T a, U b) {
+	return a < (T)b ? a : (T)b;
+}
+
+static inline char *ltoa(long value, char *str, int radix) {
+	(void)radix; // always 10 here
+	sprintf(str, "%ld", value);
+	return str;
+}
+
+static inline char *ultoa(unsigned long value, char *str, int radix) {
+	(void)radix;
+	sprintf(str, "%lu", value);
+	return str;
+}
+
+static inline char *itoa(int value, char *str, int radix) {
+	return ltoa(value, str, radix);
+}
+
+static inline char *dtostrf(double value, signed char width, unsigned char prec, char *str) {
+	sprintf(str, "%*.*f", width, prec, value);
+	return str;
+}
+
+#endif
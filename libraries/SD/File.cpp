@@ -124,6 +124,13 @@ uint32_t File::size() {
   return _file->fileSize();
 }
 
+// FAT date in the high word, FAT time in the low word
+uint32_t File::lastWrite() {
+  dir_t d;
+  if (! _file || ! _file->dirEntry(&d)) return 0;
+  return ((uint32_t)d.lastWriteDate << 16) | d.lastWriteTime;
+}
+
 void File::close() {
   if (_file) {
     _file->close();
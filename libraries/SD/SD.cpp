@@ -463,6 +463,40 @@ File SDClass::open(const char *filepath, uint8_t mode) {
 
   if (mode & (O_APPEND | O_WRITE)) 
     file.seekSet(file.fileSize());
+  else
+    // read only files are streamed, look the cluster chain up once
+    file.mapExtents();
+  return File(file, filepath);
+}
+
+
+File SDClass::createContiguous(const char *filepath, uint32_t size) {
+  /*
+
+     Create a file of `size` bytes whose clusters are contiguous and
+     open it for reading and writing at position zero. Fails if the
+     file already exists or there is no free run large enough.
+
+   */
+
+  int pathidx;
+
+  SdFile parentdir = getParentDir(filepath, &pathidx);
+  filepath += pathidx;
+
+  if (!filepath[0] || !parentdir.isOpen())
+    return File();
+
+  SdFile file;
+  boolean created;
+  if (parentdir.isRoot()) {
+    created = file.createContiguous(&root, filepath, size);
+  } else {
+    created = file.createContiguous(&parentdir, filepath, size);
+    parentdir.close();
+  }
+  if (!created)
+    return File();
   return File(file, filepath);
 }
 
@@ -41,6 +41,7 @@ public:
   boolean seek(uint32_t pos);
   uint32_t position();
   uint32_t size();
+  uint32_t lastWrite();
   void close();
   operator bool();
   char * name();
@@ -95,6 +96,11 @@ public:
   File open(const char *filename, uint8_t mode = FILE_READ);
   File open(const String &filename, uint8_t mode = FILE_READ) { return open( filename.c_str(), mode ); }
 
+  // Create a new file of the given size in one run of clusters and open
+  // it for reading and writing. Writes inside that size never touch the FAT.
+  File createContiguous(const char *filepath, uint32_t size);
+  File createContiguous(const String &filepath, uint32_t size) { return createContiguous( filepath.c_str(), size ); }
+
   // Methods to determine if the requested file path exists.
   boolean exists(char *filepath);
   boolean exists(const String &filepath) { return exists(filepath.c_str()); }
@@ -34,6 +34,36 @@ static void spiSend(uint8_t b) {
 static  uint8_t spiRec(void) {
   return SPI.transfer(0xFF);
 }
+// The ESP8266 SPI unit has a 64 byte FIFO (SPI_W0..W15). Moving data in
+// runs of that size keeps the bus busy instead of paying the per byte
+// setup cost of SPI.transfer(uint8_t).
+#define SPI_FIFO_SIZE 64
+/** Receive a run of bytes from the card */
+static void spiRec(uint8_t* buf, uint16_t n) {
+  memset(buf, 0xFF, n);
+  SPI.transfer(buf, n);
+}
+/** Clock in and discard a run of bytes */
+static void spiSkip(uint16_t n) {
+  uint8_t buf[SPI_FIFO_SIZE];
+  while (n > 0) {
+    uint16_t len = n < SPI_FIFO_SIZE ? n : SPI_FIFO_SIZE;
+    spiRec(buf, len);
+    n -= len;
+  }
+}
+/** Send a run of bytes to the card */
+static void spiSend(const uint8_t* src, uint16_t n) {
+  // the transfer is full duplex and overwrites its buffer
+  uint8_t buf[SPI_FIFO_SIZE];
+  while (n > 0) {
+    uint16_t len = n < SPI_FIFO_SIZE ? n : SPI_FIFO_SIZE;
+    memcpy(buf, src, len);
+    SPI.transfer(buf, len);
+    src += len;
+    n -= len;
+  }
+}
 
 //------------------------------------------------------------------------------
 // send command and return error code.  Return zero for OK
@@ -41,6 +71,9 @@ uint8_t Sd2Card::cardCommand(uint8_t cmd, uint32_t arg) {
   // end read if in partialBlockRead mode
   readEnd();
 
+  // end a multiple block read left open by sequential reads
+  readStop();
+
   // select card
   chipSelectLow();
 
@@ -166,7 +199,7 @@ uint8_t Sd2Card::init(uint32_t sckRateID, uint8_t chipSelectPin) {
 #else
 uint8_t Sd2Card::init(uint8_t sckRateID, uint8_t chipSelectPin) {
 #endif
-  errorCode_ = inBlock_ = partialBlockRead_ = type_ = 0;
+  errorCode_ = inBlock_ = partialBlockRead_ = readStream_ = type_ = 0;
   chipSelectPin_ = chipSelectPin;
   // 16-bit init start time allows over a minute
   uint16_t t0 = (uint16_t)millis();
@@ -266,6 +299,11 @@ uint8_t Sd2Card::readBlock(uint32_t block, uint8_t* dst) {
 /**
  * Read part of a 512 byte block from an SD card.
  *
+ * A read of the block following the previous one is done with a
+ * READ_MULTIPLE_BLOCK command that stays open, so sequential file reads
+ * only wait for the next data token instead of issuing a command per
+ * block.  The stream is stopped by readStop() or the next card command.
+ *
  * \param[in] block Logical block to be read.
  * \param[in] offset Number of bytes to skip at start of block
  * \param[out] dst Pointer to the location that will receive the data.
@@ -275,19 +313,27 @@ uint8_t Sd2Card::readBlock(uint32_t block, uint8_t* dst) {
  */
 uint8_t Sd2Card::readData(uint32_t block,
         uint16_t offset, uint16_t count, uint8_t* dst) {
-  uint16_t n;
   if (count == 0) return true;
   if ((count + offset) > 512) {
     goto fail;
   }
   if (!inBlock_ || block != block_ || offset < offset_) {
-    block_ = block;
-    // use address if not SDHC card
-    if (type()!= SD_CARD_TYPE_SDHC) block <<= 9;
-    if (cardCommand(CMD17, block)) {
-      error(SD_CARD_ERROR_CMD17);
-      goto fail;
+    if (readStream_ && block == block_ + 1) {
+      // next block of the open stream, finish the current one first
+      readEnd();
+      chipSelectLow();
+    } else {
+      uint8_t cmd = block == block_ + 1 ? CMD18 : CMD17;
+      uint32_t address = block;
+      // use address if not SDHC card
+      if (type()!= SD_CARD_TYPE_SDHC) address <<= 9;
+      if (cardCommand(cmd, address)) {
+        error(cmd == CMD18 ? SD_CARD_ERROR_CMD18 : SD_CARD_ERROR_CMD17);
+        goto fail;
+      }
+      readStream_ = cmd == CMD18;
     }
+    block_ = block;
     if (!waitStartBlock()) {
       goto fail;
     }
@@ -296,13 +342,12 @@ uint8_t Sd2Card::readData(uint32_t block,
   }
 
   // skip data before offset
-  for (;offset_ < offset; offset_++) {
-    spiRec();
+  if (offset_ < offset) {
+    spiSkip(offset - offset_);
+    offset_ = offset;
   }
   // transfer data
-  for (uint16_t i = 0; i < count; i++) {
-    dst[i] = spiRec();
-  }
+  spiRec(dst, count);
 
   offset_ += count;
   if (!partialBlockRead_ || offset_ >= 512) {
@@ -320,12 +365,42 @@ uint8_t Sd2Card::readData(uint32_t block,
 void Sd2Card::readEnd(void) {
   if (inBlock_) {
       // skip data and crc
-    while (offset_++ < 514) spiRec();
+    spiSkip(514 - offset_);
+    offset_ = 514;
     chipSelectHigh();
     inBlock_ = 0;
   }
 }
 //------------------------------------------------------------------------------
+/** End a multiple block read sequence started by readData().
+ *
+ * \return The value one, true, is returned for success and
+ * the value zero, false, is returned for failure.
+ */
+uint8_t Sd2Card::readStop(void) {
+  if (!readStream_) return true;
+  readEnd();
+  readStream_ = 0;
+
+  // not sent with cardCommand() since that would end up back here
+  chipSelectLow();
+  spiSend(CMD12 | 0x40);
+  for (uint8_t i = 0; i < 4; i++) spiSend(0);
+  spiSend(0xFF);
+
+  // skip the stuff byte then wait for the response
+  spiRec();
+  for (uint8_t i = 0; ((status_ = spiRec()) & 0x80) && i != 0xFF; i++)
+    ;
+  if (!waitNotBusy(SD_READ_TIMEOUT)) {
+    error(SD_CARD_ERROR_CMD12);
+    chipSelectHigh();
+    return false;
+  }
+  chipSelectHigh();
+  return true;
+}
+//------------------------------------------------------------------------------
 /** read CID or CSR register */
 uint8_t Sd2Card::readRegister(uint8_t cmd, void* buf) {
   uint8_t* dst = reinterpret_cast<uint8_t*>(buf);
@@ -335,7 +410,7 @@ uint8_t Sd2Card::readRegister(uint8_t cmd, void* buf) {
   }
   if (!waitStartBlock()) goto fail;
   // transfer data
-  for (uint16_t i = 0; i < 16; i++) dst[i] = spiRec();
+  spiRec(dst, 16);
   spiRec();  // get first crc byte
   spiRec();  // get second crc byte
   chipSelectHigh();
@@ -484,9 +559,7 @@ uint8_t Sd2Card::writeData(const uint8_t* src) {
 // send one block of data for write block or write multiple blocks
 uint8_t Sd2Card::writeData(uint8_t token, const uint8_t* src) {
   spiSend(token);
-  for (uint16_t i = 0; i < 512; i++) {
-    spiSend(src[i]);
-  }
+  spiSend(src, 512);
   spiSend(0xff);  // dummy crc
   spiSend(0xff);  // dummy crc
   status_ = spiRec();
@@ -124,6 +124,8 @@ uint8_t const SD_CARD_ERROR_WRITE_PROGRAMMING = 0X14;
 uint8_t const SD_CARD_ERROR_WRITE_TIMEOUT = 0X15;
 /** incorrect rate selected */
 uint8_t const SD_CARD_ERROR_SCK_RATE = 0X16;
+uint8_t const SD_CARD_ERROR_CMD18 = 0X17;
+uint8_t const SD_CARD_ERROR_CMD12 = 0X18;
 //------------------------------------------------------------------------------
 // card types
 /** Standard capacity V1 SD card */
@@ -140,7 +142,8 @@ uint8_t const SD_CARD_TYPE_SDHC = 3;
 class Sd2Card {
  public:
   /** Construct an instance of Sd2Card. */
-  Sd2Card(void) : errorCode_(0), inBlock_(0), partialBlockRead_(0), type_(0) {}
+  Sd2Card(void) : block_(0XFFFFFFFF), errorCode_(0), inBlock_(0),
+    partialBlockRead_(0), readStream_(0), type_(0) {}
   uint32_t cardSize(void);
   uint8_t erase(uint32_t firstBlock, uint32_t lastBlock);
   uint8_t eraseSingleBlockEnable(void);
@@ -193,6 +196,7 @@ class Sd2Card {
     return readRegister(CMD9, csd);
   }
   void readEnd(void);
+  uint8_t readStop(void);
   #ifdef ESP8266
   uint8_t setSckRate(uint32_t sckRateID);
   #else
@@ -211,6 +215,7 @@ class Sd2Card {
   uint8_t inBlock_;
   uint16_t offset_;
   uint8_t partialBlockRead_;
+  uint8_t readStream_;
   uint8_t status_;
   uint8_t type_;
   // private functions
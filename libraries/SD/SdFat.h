@@ -35,6 +35,14 @@
  */
 #define ALLOW_DEPRECATED_FUNCTIONS 1
 //------------------------------------------------------------------------------
+/**
+ * RAM used by the SdVolume block cache in bytes, rounded down to whole
+ * 512 byte blocks with a minimum of one block.
+ */
+#ifndef SD_CACHE_SIZE
+#define SD_CACHE_SIZE 2048
+#endif  // SD_CACHE_SIZE
+//------------------------------------------------------------------------------
 // forward declaration since SdVolume is used in SdFile
 class SdVolume;
 //==============================================================================
@@ -130,6 +138,23 @@ uint16_t const FAT_DEFAULT_DATE = ((2000 - 1980) << 9) | (1 << 5) | 1;
 /** Default time for file timestamp is 1 am */
 uint16_t const FAT_DEFAULT_TIME = (1 << 11);
 //------------------------------------------------------------------------------
+/**
+ * Number of cluster runs remembered by SdFile::mapExtents().  A file
+ * with more fragments falls back to following the FAT past the last run.
+ */
+#ifndef SD_EXTENT_COUNT
+#define SD_EXTENT_COUNT 4
+#endif  // SD_EXTENT_COUNT
+/**
+ * \brief A run of consecutive clusters in a file's cluster chain
+ */
+struct extent_t {
+           /** First cluster of the run. */
+  uint32_t firstCluster;
+           /** Number of clusters in the run. */
+  uint32_t clusterCount;
+};
+//------------------------------------------------------------------------------
 /**
  * \class SdFile
  * \brief Access FAT16 and FAT32 files on SD and SDHC cards.
@@ -137,7 +162,7 @@ uint16_t const FAT_DEFAULT_TIME = (1 << 11);
 class SdFile : public Print {
  public:
   /** Create an instance of SdFile. */
-  SdFile(void) : type_(FAT_FILE_TYPE_CLOSED) {}
+  SdFile(void) : type_(FAT_FILE_TYPE_CLOSED), extentCount_(0) {}
   /**
    * writeError is set to true if an error occurs during a write().
    * Set writeError to false before calling print() and/or write() and check
@@ -212,6 +237,11 @@ class SdFile : public Print {
   uint8_t isDir(void) const {return type_ >= FAT_FILE_TYPE_MIN_DIR;}
   /** \return True if this is a SdFile for a file else false. */
   uint8_t isFile(void) const {return type_ == FAT_FILE_TYPE_NORMAL;}
+  /** \return True if the whole file is one run of clusters.
+   *  Only valid after mapExtents(). */
+  uint8_t isContiguous(void) const {
+    return extentComplete_ && extentCount_ == 1;
+  }
   /** \return True if this is a SdFile for an open file/directory else false. */
   uint8_t isOpen(void) const {return type_ != FAT_FILE_TYPE_CLOSED;}
   /** \return True if this is a SdFile for a subdirectory else false. */
@@ -222,6 +252,7 @@ class SdFile : public Print {
   }
   void ls(uint8_t flags = 0, uint8_t indent = 0);
   uint8_t makeDir(SdFile* dir, const char* dirName);
+  uint8_t mapExtents(void);
   uint8_t open(SdFile* dirFile, uint16_t index, uint8_t oflag);
   uint8_t open(SdFile* dirFile, const char* fileName, uint8_t oflag);
 
@@ -394,11 +425,15 @@ class SdFile : public Print {
   uint32_t  fileSize_;      // file size in bytes
   uint32_t  firstCluster_;  // first cluster of file
   SdVolume* vol_;           // volume where file is located
+  extent_t  extents_[SD_EXTENT_COUNT];  // cluster runs found by mapExtents()
+  uint8_t   extentCount_;   // valid runs in extents_, zero if not mapped
+  uint8_t   extentComplete_;  // extents_ covers the whole cluster chain
 
   // private functions
   uint8_t addCluster(void);
   uint8_t addDirCluster(void);
   dir_t* cacheDirEntry(uint8_t action);
+  uint32_t extentCluster(uint32_t index) const;
   static void (*dateTime_)(uint16_t* date, uint16_t* time);
   static uint8_t make83Name(const char* str, uint8_t* name);
   uint8_t openCachedEntry(uint8_t cacheIndex, uint8_t oflags);
@@ -424,6 +459,24 @@ union cache_t {
   fbs_t    fbs;
 };
 //------------------------------------------------------------------------------
+/** number of blocks held by the SdVolume cache */
+uint8_t const SD_CACHE_BLOCKS = SD_CACHE_SIZE < 1024 ? 1 : SD_CACHE_SIZE / 512;
+/**
+ * \brief Bookkeeping for one block of the SdVolume cache
+ */
+struct cache_slot_t {
+           /** Logical block held by the slot, 0XFFFFFFFF if unused. */
+  uint32_t block;
+           /** Block of the mirror FAT to write on flush, zero if none. */
+  uint32_t mirrorBlock;
+           /** Value of the cache clock at the last access, for LRU. */
+  uint32_t lastUse;
+           /** Write the block back before it is reused. */
+  uint8_t  dirty;
+           /** Eviction priority, see SdVolume::CACHE_PRIORITY_DATA. */
+  uint8_t  priority;
+};
+//------------------------------------------------------------------------------
 /**
  * \class SdVolume
  * \brief Access FAT16 and FAT32 volumes on SD and SDHC cards.
@@ -437,8 +490,8 @@ class SdVolume {
    */
   static uint8_t* cacheClear(void) {
     cacheFlush();
-    cacheBlockNumber_ = 0XFFFFFFFF;
-    return cacheBuffer_.data;
+    cacheInvalidate();
+    return cacheBuffer_->data;
   }
   /**
    * Initialize a FAT volume.  Try partition one first then try super
@@ -478,6 +531,29 @@ class SdVolume {
   uint32_t rootDirStart(void) const {return rootDirStart_;}
   /** return a pointer to the Sd2Card object for this volume */
   static Sd2Card* sdCard(void) {return sdCard_;}
+
+  // cache priorities, the lowest class present is evicted first
+  /** cached file data, mostly streamed once */
+  static uint8_t const CACHE_PRIORITY_DATA = 0;
+  /** cached directory blocks */
+  static uint8_t const CACHE_PRIORITY_DIR = 1;
+  /** cached FAT blocks, hit on every cluster boundary */
+  static uint8_t const CACHE_PRIORITY_FAT = 2;
+  /** number of cache priority classes */
+  static uint8_t const CACHE_PRIORITY_COUNT = 3;
+
+  /** \return The number of blocks in the cache. */
+  static uint8_t cacheBlockCount(void) {return SD_CACHE_BLOCKS;}
+  /** \return Cache hits for blocks of the given priority. */
+  static uint32_t cacheHits(uint8_t priority) {return cacheHits_[priority];}
+  /** \return Cache misses for blocks of the given priority. */
+  static uint32_t cacheMisses(uint8_t priority) {
+    return cacheMisses_[priority];
+  }
+  /** \return Number of dirty blocks written back to the card. */
+  static uint32_t cacheWrites(void) {return cacheWrites_;}
+  /** Reset the cache statistics. */
+  static void cacheResetStats(void);
 //------------------------------------------------------------------------------
 #if ALLOW_DEPRECATED_FUNCTIONS
   // Deprecated functions  - suppress cpplint warnings with NOLINT comment
@@ -499,11 +575,15 @@ class SdVolume {
   // value for action argument in cacheRawBlock to indicate cache dirty
   static uint8_t const CACHE_FOR_WRITE = 1;
 
-  static cache_t cacheBuffer_;        // 512 byte cache for device blocks
-  static uint32_t cacheBlockNumber_;  // Logical number of block in the cache
+  static cache_t cacheBlocks_[SD_CACHE_BLOCKS];      // 512 byte blocks
+  static cache_slot_t cacheSlots_[SD_CACHE_BLOCKS];  // state of each block
+  static uint8_t cacheCurrent_;       // slot of the most recently used block
+  static cache_t* cacheBuffer_;       // block in the current slot
+  static uint32_t cacheClock_;        // incremented on every cache access
   static Sd2Card* sdCard_;            // Sd2Card object for cache
-  static uint8_t cacheDirty_;         // cacheFlush() will write block if true
-  static uint32_t cacheMirrorBlock_;  // block number for mirror FAT
+  static uint32_t cacheHits_[CACHE_PRIORITY_COUNT];
+  static uint32_t cacheMisses_[CACHE_PRIORITY_COUNT];
+  static uint32_t cacheWrites_;
 //
   uint32_t allocSearchStart_;   // start cluster for alloc search
   uint8_t blocksPerCluster_;    // cluster size in blocks
@@ -524,10 +604,22 @@ class SdVolume {
            return dataStartBlock_ + ((cluster - 2) << clusterSizeShift_);}
   uint32_t blockNumber(uint32_t cluster, uint32_t position) const {
            return clusterStartBlock(cluster) + blockOfCluster(position);}
+  static uint8_t cacheAllocBlock(uint32_t blockNumber, uint8_t priority);
+  static uint32_t cacheBlockNumber(void) {
+    return cacheSlots_[cacheCurrent_].block;
+  }
+  static int8_t cacheFind(uint32_t blockNumber);
   static uint8_t cacheFlush(void);
-  static uint8_t cacheRawBlock(uint32_t blockNumber, uint8_t action);
-  static void cacheSetDirty(void) {cacheDirty_ |= CACHE_FOR_WRITE;}
-  static uint8_t cacheZeroBlock(uint32_t blockNumber);
+  static uint8_t cacheFlushSlot(uint8_t slot);
+  static void cacheInvalidate(void);
+  static void cacheInvalidate(uint32_t blockNumber);
+  static uint8_t cacheRawBlock(uint32_t blockNumber, uint8_t action,
+                               uint8_t priority = CACHE_PRIORITY_DATA);
+  static void cacheSelect(uint8_t slot, uint8_t priority);
+  static void cacheSetDirty(void) {
+    cacheSlots_[cacheCurrent_].dirty |= CACHE_FOR_WRITE;
+  }
+  static uint8_t cacheZeroBlock(uint32_t blockNumber, uint8_t priority);
   uint8_t chainSize(uint32_t beginCluster, uint32_t* size) const;
   uint8_t fatGet(uint32_t cluster, uint32_t* value) const;
   uint8_t fatPut(uint32_t cluster, uint32_t value);
@@ -37,6 +37,9 @@ void (*SdFile::oldDateTime_)(uint16_t& date, uint16_t& time) = NULL;  // NOLINT
 uint8_t SdFile::addCluster() {
   if (!vol_->allocContiguous(1, &curCluster_)) return false;
 
+  // the chain grew, clusters past the mapped runs are found in the FAT
+  extentComplete_ = false;
+
   // if first cluster of file link to directory entry
   if (firstCluster_ == 0) {
     firstCluster_ = curCluster_;
@@ -53,7 +56,8 @@ uint8_t SdFile::addDirCluster(void) {
   // zero data in cluster insure first cluster is in cache
   uint32_t block = vol_->clusterStartBlock(curCluster_);
   for (uint8_t i = vol_->blocksPerCluster_; i != 0; i--) {
-    if (!SdVolume::cacheZeroBlock(block + i - 1)) return false;
+    if (!SdVolume::cacheZeroBlock(block + i - 1,
+                                  SdVolume::CACHE_PRIORITY_DIR)) return false;
   }
   // Increase directory file size by cluster size
   fileSize_ += 512UL << vol_->clusterSizeShift_;
@@ -63,8 +67,9 @@ uint8_t SdFile::addDirCluster(void) {
 // cache a file's directory entry
 // return pointer to cached entry or null for failure
 dir_t* SdFile::cacheDirEntry(uint8_t action) {
-  if (!SdVolume::cacheRawBlock(dirBlock_, action)) return NULL;
-  return SdVolume::cacheBuffer_.dir + dirIndex_;
+  if (!SdVolume::cacheRawBlock(dirBlock_, action,
+                               SdVolume::CACHE_PRIORITY_DIR)) return NULL;
+  return SdVolume::cacheBuffer_->dir + dirIndex_;
 }
 //------------------------------------------------------------------------------
 /**
@@ -146,11 +151,29 @@ uint8_t SdFile::createContiguous(SdFile* dirFile,
   }
   fileSize_ = size;
 
+  // the file is a single run by construction
+  extents_[0].firstCluster = firstCluster_;
+  extents_[0].clusterCount = count;
+  extentCount_ = 1;
+  extentComplete_ = true;
+
   // insure sync() will update dir entry
   flags_ |= F_FILE_DIR_DIRTY;
   return sync();
 }
 //------------------------------------------------------------------------------
+// return the volume cluster holding the file's cluster number index
+// or zero if it is past the mapped runs
+uint32_t SdFile::extentCluster(uint32_t index) const {
+  for (uint8_t i = 0; i < extentCount_; i++) {
+    if (index < extents_[i].clusterCount) {
+      return extents_[i].firstCluster + index;
+    }
+    index -= extents_[i].clusterCount;
+  }
+  return 0;
+}
+//------------------------------------------------------------------------------
 /**
  * Return a files directory entry
  *
@@ -321,10 +344,11 @@ uint8_t SdFile::makeDir(SdFile* dir, const char* dirName) {
 
   // cache block for '.'  and '..'
   uint32_t block = vol_->clusterStartBlock(firstCluster_);
-  if (!SdVolume::cacheRawBlock(block, SdVolume::CACHE_FOR_WRITE)) return false;
+  if (!SdVolume::cacheRawBlock(block, SdVolume::CACHE_FOR_WRITE,
+                               SdVolume::CACHE_PRIORITY_DIR)) return false;
 
   // copy '.' to block
-  memcpy(&SdVolume::cacheBuffer_.dir[0], &d, sizeof(d));
+  memcpy(&SdVolume::cacheBuffer_->dir[0], &d, sizeof(d));
 
   // make entry for '..'
   d.name[1] = '.';
@@ -336,7 +360,7 @@ uint8_t SdFile::makeDir(SdFile* dir, const char* dirName) {
     d.firstClusterHigh = dir->firstCluster_ >> 16;
   }
   // copy '..' to block
-  memcpy(&SdVolume::cacheBuffer_.dir[1], &d, sizeof(d));
+  memcpy(&SdVolume::cacheBuffer_->dir[1], &d, sizeof(d));
 
   // set position after '..'
   curPosition_ = 2 * sizeof(d);
@@ -345,6 +369,56 @@ uint8_t SdFile::makeDir(SdFile* dir, const char* dirName) {
   return SdVolume::cacheFlush();
 }
 //------------------------------------------------------------------------------
+/**
+ * Compute the run list of a file's cluster chain.
+ *
+ * After this, reads and seeks within the mapped runs find their block by
+ * arithmetic instead of following the chain in the FAT.  Up to
+ * SD_EXTENT_COUNT runs are kept, which covers a contiguous file and a
+ * lightly fragmented one; reads past the last run use the FAT as before.
+ * Intended for files opened to be streamed, the chain is walked once.
+ *
+ * \return The value one, true, is returned for success and
+ * the value zero, false, is returned for failure.
+ * Reasons for failure include the file is not open, is a directory or
+ * an I/O error occurred.
+ */
+uint8_t SdFile::mapExtents(void) {
+  extentCount_ = 0;
+  extentComplete_ = false;
+  if (!isFile()) return false;
+
+  // empty file, nothing to map
+  if (firstCluster_ == 0) {
+    extentComplete_ = true;
+    return true;
+  }
+  uint32_t c = firstCluster_;
+  extents_[0].firstCluster = c;
+  extents_[0].clusterCount = 1;
+  extentCount_ = 1;
+  for (;;) {
+    uint32_t next;
+    if (!vol_->fatGet(c, &next)) {
+      extentCount_ = 0;
+      return false;
+    }
+    if (vol_->isEOC(next)) break;
+    if (next == c + 1) {
+      extents_[extentCount_ - 1].clusterCount++;
+    } else {
+      // out of runs, the rest of the chain stays in the FAT
+      if (extentCount_ == SD_EXTENT_COUNT) return true;
+      extents_[extentCount_].firstCluster = next;
+      extents_[extentCount_].clusterCount = 1;
+      extentCount_++;
+    }
+    c = next;
+  }
+  extentComplete_ = true;
+  return true;
+}
+//------------------------------------------------------------------------------
 /**
  * Open a file or directory by name.
  *
@@ -416,7 +490,7 @@ uint8_t SdFile::open(SdFile* dirFile, const char* fileName, uint8_t oflag) {
       if (!emptyFound) {
         emptyFound = true;
         dirIndex_ = index;
-        dirBlock_ = SdVolume::cacheBlockNumber_;
+        dirBlock_ = SdVolume::cacheBlockNumber();
       }
       // done if no entries follow
       if (p->name[0] == DIR_NAME_FREE) break;
@@ -443,7 +517,7 @@ uint8_t SdFile::open(SdFile* dirFile, const char* fileName, uint8_t oflag) {
 
     // use first entry in cluster
     dirIndex_ = 0;
-    p = SdVolume::cacheBuffer_.dir;
+    p = SdVolume::cacheBuffer_->dir;
   }
   // initialize as empty file
   memset(p, 0, sizeof(dir_t));
@@ -511,7 +585,7 @@ uint8_t SdFile::open(SdFile* dirFile, uint16_t index, uint8_t oflag) {
 // open a cached directory entry. Assumes vol_ is initializes
 uint8_t SdFile::openCachedEntry(uint8_t dirIndex, uint8_t oflag) {
   // location of entry in cache
-  dir_t* p = SdVolume::cacheBuffer_.dir + dirIndex;
+  dir_t* p = SdVolume::cacheBuffer_->dir + dirIndex;
 
   // write or truncate is an error for a directory or read-only file
   if (p->attributes & (DIR_ATT_READ_ONLY | DIR_ATT_DIRECTORY)) {
@@ -519,7 +593,7 @@ uint8_t SdFile::openCachedEntry(uint8_t dirIndex, uint8_t oflag) {
   }
   // remember location of directory entry on SD
   dirIndex_ = dirIndex;
-  dirBlock_ = SdVolume::cacheBlockNumber_;
+  dirBlock_ = SdVolume::cacheBlockNumber();
 
   // copy first cluster number for directory fields
   firstCluster_ = (uint32_t)p->firstClusterHigh << 16;
@@ -541,6 +615,7 @@ uint8_t SdFile::openCachedEntry(uint8_t dirIndex, uint8_t oflag) {
   // set to start of file
   curCluster_ = 0;
   curPosition_ = 0;
+  extentCount_ = 0;
 
   // truncate file to zero length if requested
   if (oflag & O_TRUNC) return truncate(0);
@@ -580,6 +655,7 @@ uint8_t SdFile::openRoot(SdVolume* vol) {
   // set to start of file
   curCluster_ = 0;
   curPosition_ = 0;
+  extentCount_ = 0;
 
   // root has no directory entry
   dirBlock_ = 0;
@@ -687,7 +763,12 @@ int16_t SdFile::read(void* buf, uint16_t nbyte) {
       uint8_t blockOfCluster = vol_->blockOfCluster(curPosition_);
       if (offset == 0 && blockOfCluster == 0) {
         // start of new cluster
-        if (curPosition_ == 0) {
+        uint32_t mapped = extentCluster(curPosition_ >>
+                                        (vol_->clusterSizeShift_ + 9));
+        if (mapped) {
+          // within the mapped runs, no FAT access needed
+          curCluster_ = mapped;
+        } else if (curPosition_ == 0) {
           // use first cluster in file
           curCluster_ = firstCluster_;
         } else {
@@ -703,14 +784,16 @@ int16_t SdFile::read(void* buf, uint16_t nbyte) {
     if (n > (512 - offset)) n = 512 - offset;
 
     // no buffering needed if n == 512 or user requests no buffering
-    if ((unbufferedRead() || n == 512) &&
-      block != SdVolume::cacheBlockNumber_) {
+    if ((unbufferedRead() || n == 512) && SdVolume::cacheFind(block) < 0) {
       if (!vol_->readData(block, offset, n, dst)) return -1;
       dst += n;
     } else {
       // read block to cache and copy data to caller
-      if (!SdVolume::cacheRawBlock(block, SdVolume::CACHE_FOR_READ)) return -1;
-      uint8_t* src = SdVolume::cacheBuffer_.data + offset;
+      uint8_t priority = isDir() ? SdVolume::CACHE_PRIORITY_DIR
+                                 : SdVolume::CACHE_PRIORITY_DATA;
+      if (!SdVolume::cacheRawBlock(block, SdVolume::CACHE_FOR_READ,
+                                   priority)) return -1;
+      uint8_t* src = SdVolume::cacheBuffer_->data + offset;
       uint8_t* end = src + n;
       while (src != end) *dst++ = *src++;
     }
@@ -764,7 +847,7 @@ dir_t* SdFile::readDirCache(void) {
   curPosition_ += 31;
 
   // return pointer to entry
-  return (SdVolume::cacheBuffer_.dir + i);
+  return (SdVolume::cacheBuffer_->dir + i);
 }
 //------------------------------------------------------------------------------
 /**
@@ -941,6 +1024,14 @@ uint8_t SdFile::seekSet(uint32_t pos) {
   uint32_t nCur = (curPosition_ - 1) >> (vol_->clusterSizeShift_ + 9);
   uint32_t nNew = (pos - 1) >> (vol_->clusterSizeShift_ + 9);
 
+  // the new position is in a mapped run
+  uint32_t mapped = extentCluster(nNew);
+  if (mapped) {
+    curCluster_ = mapped;
+    curPosition_ = pos;
+    return true;
+  }
+
   if (nNew < nCur || curPosition_ == 0) {
     // must follow chain from first cluster
     curCluster_ = firstCluster_;
@@ -1088,6 +1179,9 @@ uint8_t SdFile::truncate(uint32_t length) {
   // position to last cluster in truncated file
   if (!seekSet(length)) return false;
 
+  // freed clusters may be in the mapped runs
+  extentCount_ = 0;
+
   if (length == 0) {
     // free all clusters
     if (!vol_->freeChain(firstCluster_)) return false;
@@ -1180,16 +1274,15 @@ size_t SdFile::write(const void* buf, uint16_t nbyte) {
     if (n == 512) {
       // full block - don't need to use cache
       // invalidate cache if block is in cache
-      if (SdVolume::cacheBlockNumber_ == block) {
-        SdVolume::cacheBlockNumber_ = 0XFFFFFFFF;
-      }
+      SdVolume::cacheInvalidate(block);
       if (!vol_->writeBlock(block, src)) goto writeErrorReturn;
       src += 512;
     } else {
       if (blockOffset == 0 && curPosition_ >= fileSize_) {
         // start of new block don't need to read into cache
-        if (!SdVolume::cacheFlush()) goto writeErrorReturn;
-        SdVolume::cacheBlockNumber_ = block;
+        if (!SdVolume::cacheAllocBlock(block, SdVolume::CACHE_PRIORITY_DATA)) {
+          goto writeErrorReturn;
+        }
         SdVolume::cacheSetDirty();
       } else {
         // rewrite part of block
@@ -1197,7 +1290,7 @@ size_t SdFile::write(const void* buf, uint16_t nbyte) {
           goto writeErrorReturn;
         }
       }
-      uint8_t* dst = SdVolume::cacheBuffer_.data + blockOffset;
+      uint8_t* dst = SdVolume::cacheBuffer_->data + blockOffset;
       uint8_t* end = dst + n;
       while (dst != end) *dst++ = *src++;
     }
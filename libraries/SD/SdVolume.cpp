@@ -20,12 +20,16 @@
 #include "SdFat.h"
 //------------------------------------------------------------------------------
 // raw block cache
-// init cacheBlockNumber_to invalid SD block number
-uint32_t SdVolume::cacheBlockNumber_ = 0XFFFFFFFF;
-cache_t  SdVolume::cacheBuffer_;     // 512 byte cache for Sd2Card
-Sd2Card* SdVolume::sdCard_;          // pointer to SD card object
-uint8_t  SdVolume::cacheDirty_ = 0;  // cacheFlush() will write block if true
-uint32_t SdVolume::cacheMirrorBlock_ = 0;  // mirror  block for second FAT
+// slots are marked unused by cacheInvalidate() in init()
+cache_t      SdVolume::cacheBlocks_[SD_CACHE_BLOCKS];
+cache_slot_t SdVolume::cacheSlots_[SD_CACHE_BLOCKS];
+uint8_t      SdVolume::cacheCurrent_ = 0;
+cache_t*     SdVolume::cacheBuffer_ = &SdVolume::cacheBlocks_[0];
+uint32_t     SdVolume::cacheClock_ = 0;
+Sd2Card*     SdVolume::sdCard_;          // pointer to SD card object
+uint32_t     SdVolume::cacheHits_[CACHE_PRIORITY_COUNT];
+uint32_t     SdVolume::cacheMisses_[CACHE_PRIORITY_COUNT];
+uint32_t     SdVolume::cacheWrites_ = 0;
 //------------------------------------------------------------------------------
 // find a contiguous group of clusters
 uint8_t SdVolume::allocContiguous(uint32_t count, uint32_t* curCluster) {
@@ -96,42 +100,139 @@ uint8_t SdVolume::allocContiguous(uint32_t count, uint32_t* curCluster) {
   return true;
 }
 //------------------------------------------------------------------------------
+// find a slot for blockNumber without reading it, flushing the victim
+// return with the slot selected as the current one
+uint8_t SdVolume::cacheAllocBlock(uint32_t blockNumber, uint8_t priority) {
+  int8_t slot = cacheFind(blockNumber);
+  if (slot < 0) {
+    // unused slot, else LRU slot of the lowest priority class present
+    slot = 0;
+    for (uint8_t i = 0; i < SD_CACHE_BLOCKS; i++) {
+      cache_slot_t* s = &cacheSlots_[i];
+      cache_slot_t* v = &cacheSlots_[slot];
+      if (s->block == 0XFFFFFFFF) {
+        slot = i;
+        break;
+      }
+      if (s->priority < v->priority ||
+        (s->priority == v->priority &&
+          (cacheClock_ - s->lastUse) > (cacheClock_ - v->lastUse))) {
+        slot = i;
+      }
+    }
+    if (!cacheFlushSlot(slot)) return false;
+    cacheSlots_[slot].block = blockNumber;
+  }
+  cacheSelect(slot, priority);
+  return true;
+}
+//------------------------------------------------------------------------------
+// return the slot holding blockNumber or -1
+int8_t SdVolume::cacheFind(uint32_t blockNumber) {
+  for (uint8_t i = 0; i < SD_CACHE_BLOCKS; i++) {
+    if (cacheSlots_[i].block == blockNumber) return i;
+  }
+  return -1;
+}
+//------------------------------------------------------------------------------
+// write all dirty blocks - file data first then FAT then directory entries
+// so a directory entry never points at data that isn't on the card yet
 uint8_t SdVolume::cacheFlush(void) {
-  if (cacheDirty_) {
-    if (!sdCard_->writeBlock(cacheBlockNumber_, cacheBuffer_.data)) {
+  static uint8_t const order[CACHE_PRIORITY_COUNT] = {
+    CACHE_PRIORITY_DATA, CACHE_PRIORITY_FAT, CACHE_PRIORITY_DIR
+  };
+  for (uint8_t p = 0; p < CACHE_PRIORITY_COUNT; p++) {
+    for (uint8_t i = 0; i < SD_CACHE_BLOCKS; i++) {
+      if (cacheSlots_[i].priority != order[p]) continue;
+      if (!cacheFlushSlot(i)) return false;
+    }
+  }
+  return true;
+}
+//------------------------------------------------------------------------------
+uint8_t SdVolume::cacheFlushSlot(uint8_t slot) {
+  cache_slot_t* s = &cacheSlots_[slot];
+  if (s->dirty) {
+    if (!sdCard_->writeBlock(s->block, cacheBlocks_[slot].data)) {
       return false;
     }
     // mirror FAT tables
-    if (cacheMirrorBlock_) {
-      if (!sdCard_->writeBlock(cacheMirrorBlock_, cacheBuffer_.data)) {
+    if (s->mirrorBlock) {
+      if (!sdCard_->writeBlock(s->mirrorBlock, cacheBlocks_[slot].data)) {
         return false;
       }
-      cacheMirrorBlock_ = 0;
+      s->mirrorBlock = 0;
     }
-    cacheDirty_ = 0;
+    s->dirty = 0;
+    cacheWrites_++;
   }
   return true;
 }
 //------------------------------------------------------------------------------
-uint8_t SdVolume::cacheRawBlock(uint32_t blockNumber, uint8_t action) {
-  if (cacheBlockNumber_ != blockNumber) {
-    if (!cacheFlush()) return false;
-    if (!sdCard_->readBlock(blockNumber, cacheBuffer_.data)) return false;
-    cacheBlockNumber_ = blockNumber;
+// drop all blocks, call cacheFlush() first to keep changes
+void SdVolume::cacheInvalidate(void) {
+  for (uint8_t i = 0; i < SD_CACHE_BLOCKS; i++) {
+    cacheSlots_[i].block = 0XFFFFFFFF;
+    cacheSlots_[i].mirrorBlock = 0;
+    cacheSlots_[i].dirty = 0;
+    cacheSlots_[i].priority = CACHE_PRIORITY_DATA;
   }
-  cacheDirty_ |= action;
+  cacheCurrent_ = 0;
+  cacheBuffer_ = &cacheBlocks_[0];
+}
+//------------------------------------------------------------------------------
+// drop blockNumber after it has been written around the cache
+void SdVolume::cacheInvalidate(uint32_t blockNumber) {
+  int8_t slot = cacheFind(blockNumber);
+  if (slot >= 0) {
+    cacheSlots_[slot].block = 0XFFFFFFFF;
+    cacheSlots_[slot].dirty = 0;
+    cacheSlots_[slot].mirrorBlock = 0;
+  }
+}
+//------------------------------------------------------------------------------
+uint8_t SdVolume::cacheRawBlock(uint32_t blockNumber, uint8_t action,
+                                uint8_t priority) {
+  int8_t slot = cacheFind(blockNumber);
+  if (slot >= 0) {
+    cacheHits_[priority]++;
+    cacheSelect(slot, priority);
+  } else {
+    cacheMisses_[priority]++;
+    if (!cacheAllocBlock(blockNumber, priority)) return false;
+    if (!sdCard_->readBlock(blockNumber, cacheBuffer_->data)) {
+      cacheSlots_[cacheCurrent_].block = 0XFFFFFFFF;
+      return false;
+    }
+  }
+  cacheSlots_[cacheCurrent_].dirty |= action;
   return true;
 }
 //------------------------------------------------------------------------------
+void SdVolume::cacheResetStats(void) {
+  for (uint8_t i = 0; i < CACHE_PRIORITY_COUNT; i++) {
+    cacheHits_[i] = 0;
+    cacheMisses_[i] = 0;
+  }
+  cacheWrites_ = 0;
+}
+//------------------------------------------------------------------------------
+// make slot the current one and record the access
+void SdVolume::cacheSelect(uint8_t slot, uint8_t priority) {
+  cacheCurrent_ = slot;
+  cacheBuffer_ = &cacheBlocks_[slot];
+  cacheSlots_[slot].lastUse = ++cacheClock_;
+  cacheSlots_[slot].priority = priority;
+}
+//------------------------------------------------------------------------------
 // cache a zero block for blockNumber
-uint8_t SdVolume::cacheZeroBlock(uint32_t blockNumber) {
-  if (!cacheFlush()) return false;
+uint8_t SdVolume::cacheZeroBlock(uint32_t blockNumber, uint8_t priority) {
+  if (!cacheAllocBlock(blockNumber, priority)) return false;
 
-  // loop take less flash than memset(cacheBuffer_.data, 0, 512);
+  // loop take less flash than memset(cacheBuffer_->data, 0, 512);
   for (uint16_t i = 0; i < 512; i++) {
-    cacheBuffer_.data[i] = 0;
+    cacheBuffer_->data[i] = 0;
   }
-  cacheBlockNumber_ = blockNumber;
   cacheSetDirty();
   return true;
 }
@@ -152,13 +253,13 @@ uint8_t SdVolume::fatGet(uint32_t cluster, uint32_t* value) const {
   if (cluster > (clusterCount_ + 1)) return false;
   uint32_t lba = fatStartBlock_;
   lba += fatType_ == 16 ? cluster >> 8 : cluster >> 7;
-  if (lba != cacheBlockNumber_) {
-    if (!cacheRawBlock(lba, CACHE_FOR_READ)) return false;
+  if (lba != cacheBlockNumber()) {
+    if (!cacheRawBlock(lba, CACHE_FOR_READ, CACHE_PRIORITY_FAT)) return false;
   }
   if (fatType_ == 16) {
-    *value = cacheBuffer_.fat16[cluster & 0XFF];
+    *value = cacheBuffer_->fat16[cluster & 0XFF];
   } else {
-    *value = cacheBuffer_.fat32[cluster & 0X7F] & FAT32MASK;
+    *value = cacheBuffer_->fat32[cluster & 0X7F] & FAT32MASK;
   }
   return true;
 }
@@ -175,19 +276,21 @@ uint8_t SdVolume::fatPut(uint32_t cluster, uint32_t value) {
   uint32_t lba = fatStartBlock_;
   lba += fatType_ == 16 ? cluster >> 8 : cluster >> 7;
 
-  if (lba != cacheBlockNumber_) {
-    if (!cacheRawBlock(lba, CACHE_FOR_READ)) return false;
+  if (lba != cacheBlockNumber()) {
+    if (!cacheRawBlock(lba, CACHE_FOR_READ, CACHE_PRIORITY_FAT)) return false;
   }
   // store entry
   if (fatType_ == 16) {
-    cacheBuffer_.fat16[cluster & 0XFF] = value;
+    cacheBuffer_->fat16[cluster & 0XFF] = value;
   } else {
-    cacheBuffer_.fat32[cluster & 0X7F] = value;
+    cacheBuffer_->fat32[cluster & 0X7F] = value;
   }
   cacheSetDirty();
 
   // mirror second FAT
-  if (fatCount_ > 1) cacheMirrorBlock_ = lba + blocksPerFat_;
+  if (fatCount_ > 1) {
+    cacheSlots_[cacheCurrent_].mirrorBlock = lba + blocksPerFat_;
+  }
   return true;
 }
 //------------------------------------------------------------------------------
@@ -226,13 +329,16 @@ uint8_t SdVolume::freeChain(uint32_t cluster) {
  */
 uint8_t SdVolume::init(Sd2Card* dev, uint8_t part) {
   uint32_t volumeStartBlock = 0;
+  // blocks cached from a previous card are meaningless for this one
+  if (sdCard_) cacheFlush();
+  cacheInvalidate();
   sdCard_ = dev;
   // if part == 0 assume super floppy with FAT boot sector in block zero
   // if part > 0 assume mbr volume with partition table
   if (part) {
     if (part > 4)return false;
     if (!cacheRawBlock(volumeStartBlock, CACHE_FOR_READ)) return false;
-    part_t* p = &cacheBuffer_.mbr.part[part-1];
+    part_t* p = &cacheBuffer_->mbr.part[part-1];
     if ((p->boot & 0X7F) !=0  ||
       p->totalSectors < 100 ||
       p->firstSector == 0) {
@@ -242,7 +348,7 @@ uint8_t SdVolume::init(Sd2Card* dev, uint8_t part) {
     volumeStartBlock = p->firstSector;
   }
   if (!cacheRawBlock(volumeStartBlock, CACHE_FOR_READ)) return false;
-  bpb_t* bpb = &cacheBuffer_.fbs.bpb;
+  bpb_t* bpb = &cacheBuffer_->fbs.bpb;
   if (bpb->bytesPerSector != 512 ||
     bpb->fatCount == 0 ||
     bpb->reservedSectorCount == 0 ||
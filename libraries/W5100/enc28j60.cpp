@@ -288,26 +288,29 @@ static void readBuf(uint16_t len, byte* data) {
     enableChip();
     if (len != 0) {    
         SPI.transfer(ENC28J60_READ_BUF_MEM);
-
-        while (len) {
-            len--;
-            *data = SPI.transfer(0x00);
-            data++;
-        }
+        // one burst through the SPI FIFO, the dummy bytes sent are don't care
+        SPI.transfer(data, len);
     }
     disableChip(); 
 }
 
+#define ENC28J60_SPI_FIFO_SIZE 64
+
 static void writeBuf(uint16_t len, const byte* data) {
     enableChip();
     if (len != 0) {
         SPI.transfer(ENC28J60_WRITE_BUF_MEM);
 
+        // a burst overwrites what it sends with what it reads,
+        // so go through a FIFO sized copy
+        byte chunk[ENC28J60_SPI_FIFO_SIZE];
         while (len) {
-            len--;
-	    SPI.transfer((byte)* data);
-            if (len) data++;
-     	};  
+            uint16_t n = len < sizeof chunk ? len : sizeof chunk;
+            memcpy(chunk, data, n);
+            SPI.transfer(chunk, n);
+            data += n;
+            len -= n;
+        }
     }
     disableChip();
 }
@@ -435,87 +438,126 @@ struct transmit_status_vector {
     uint8_t bytes[7];
 };
 
+// Gives up on a transmission that doesn't complete, see Errata Issue 13
+#define ENC28J60_TX_TIMEOUT_US 10000
+
 #if ETHERCARD_SEND_PIPELINING
-    #define BREAKORCONTINUE retry=0; continue;
-#else
-    #define BREAKORCONTINUE break;
+static byte     txSlot = 0;         // slot the next frame is written to
+static bool     txPending = false;  // the other slot was started
+static uint16_t txPendingLen;
 #endif
 
-void ENC28J60::packetSend(uint16_t len) {
-    byte retry = 0;
+static uint16_t txSlotStart (byte slot) {
+    return TXSTART_INIT + slot * TX_SLOT_SIZE;
+}
 
-    #if ETHERCARD_SEND_PIPELINING
-        goto resume_last_transmission;
-    #endif
-    while (1) {
-        // latest errata sheet: DS80349C 
-        // always reset transmit logic (Errata Issue 12)
-        // the Microchip TCP/IP stack implementation used to first check
-        // whether TXERIF is set and only then reset the transmit logic
-        // but this has been changed in later versions; possibly they
-        // have a reason for this; they don't mention this in the errata 
-        // sheet
-        writeOp(ENC28J60_BIT_FIELD_SET, ECON1, ECON1_TXRST);
-        writeOp(ENC28J60_BIT_FIELD_CLR, ECON1, ECON1_TXRST); 
-        writeOp(ENC28J60_BIT_FIELD_CLR, EIR, EIR_TXERIF|EIR_TXIF);
-   
-        // prepare new transmission 
-        if (retry == 0) {
-            writeReg(EWRPT, TXSTART_INIT);
-            writeReg(ETXND, TXSTART_INIT+len);
-            writeOp(ENC28J60_WRITE_BUF_MEM, 0, 0x00);
-            writeBuf(len, buffer);
-        }
-   
-        // initiate transmission
-        writeOp(ENC28J60_BIT_FIELD_SET, ECON1, ECON1_TXRTS);
-        #if ETHERCARD_SEND_PIPELINING
-            if (retry == 0) return;
-        #endif
+static void txWrite (uint16_t start, uint16_t len) {
+    writeReg(EWRPT, start);
+    writeOp(ENC28J60_WRITE_BUF_MEM, 0, 0x00);
+    writeBuf(len, ENC28J60::buffer);
+}
 
-    resume_last_transmission:
+static void txStart (uint16_t start, uint16_t len) {
+    // latest errata sheet: DS80349C 
+    // always reset transmit logic (Errata Issue 12)
+    // the Microchip TCP/IP stack implementation used to first check
+    // whether TXERIF is set and only then reset the transmit logic
+    // but this has been changed in later versions; possibly they
+    // have a reason for this; they don't mention this in the errata 
+    // sheet
+    writeOp(ENC28J60_BIT_FIELD_SET, ECON1, ECON1_TXRST);
+    writeOp(ENC28J60_BIT_FIELD_CLR, ECON1, ECON1_TXRST); 
+    writeOp(ENC28J60_BIT_FIELD_CLR, EIR, EIR_TXERIF|EIR_TXIF);
+
+    writeReg(ETXST, start);
+    writeReg(ETXND, start+len);
+    writeOp(ENC28J60_BIT_FIELD_SET, ECON1, ECON1_TXRTS);
+}
 
+// Waits for the frame started from 'start' to leave the chip, retrying it
+// on a late collision if configured. Returns at once when it already has.
+static void txComplete (uint16_t start, uint16_t len) {
+    for (byte retry = 0; ; retry++) {
         // wait until transmission has finished; referrring to the data sheet and 
         // to the errata (Errata Issue 13; Example 1) you only need to wait until either 
         // TXIF or TXERIF gets set; however this leads to hangs; apparently Microchip
         // realized this and in later implementations of their tcp/ip stack they introduced 
-        // a counter to avoid hangs; of course they didn't update the errata sheet 
-        uint16_t count = 0;
-        while ((readRegByte(EIR) & (EIR_TXIF | EIR_TXERIF)) == 0 && ++count < 1000U)
-            ;
-   
-        if (!(readRegByte(EIR) & EIR_TXERIF) && count < 1000U) {
-            // no error; start new transmission
-            BREAKORCONTINUE
+        // a timeout to avoid hangs; of course they didn't update the errata sheet 
+        uint32_t begin = micros();
+        byte eir;
+        bool timeout = false;
+        while (((eir = readRegByte(EIR)) & (EIR_TXIF | EIR_TXERIF)) == 0) {
+            if (micros() - begin > ENC28J60_TX_TIMEOUT_US) {
+                timeout = true;
+                break;
+            }
         }
-   
-        // cancel previous transmission if stuck
+
+        if (!(eir & EIR_TXERIF) && !timeout) {
+            // no error
+            return;
+        }
+
+        // cancel transmission if stuck
         writeOp(ENC28J60_BIT_FIELD_CLR, ECON1, ECON1_TXRTS); 
-    
-    #if ETHERCARD_RETRY_LATECOLLISIONS == 0
-        BREAKORCONTINUE
-    #endif
 
+    #if ETHERCARD_RETRY_LATECOLLISIONS == 0
+        return;
+    #else
         // Check whether the chip thinks that a late collision ocurred; the chip
         // may be wrong (Errata Issue 13); therefore we retry. We could check
         // LATECOL in the ESTAT register in order to find out whether the chip
         // thinks a late collision ocurred but (Errata Issue 15) tells us that
-        // this is not working. Therefore we check TSV
+        // this is not working. Therefore we check TSV, it follows the frame
         transmit_status_vector tsv;   
-        uint16_t etxnd = readReg(ETXND);
-        writeReg(ERDPT, etxnd+1);
+        writeReg(ERDPT, start+len+1);
         readBuf(sizeof(transmit_status_vector), (byte*) &tsv);
         // LATECOL is bit number 29 in TSV (starting from 0)
 
-        if (!((readRegByte(EIR) & EIR_TXERIF) && (tsv.bytes[3] & 1<<5) /*tsv.transmitLateCollision*/) || retry > 16U) {
+        if (!((eir & EIR_TXERIF) && (tsv.bytes[3] & 1<<5) /*tsv.transmitLateCollision*/) || retry > 16U) {
             // there was some error but no LATECOL so we do not repeat
-            BREAKORCONTINUE
+            return;
         }
-        
-        retry++;
+
+        txStart(start, len);
+    #endif
     }
 }
 
+void ENC28J60::packetSend(uint16_t len) {
+#if ETHERCARD_SEND_PIPELINING
+    // Copy the frame while the previous one is (probably) still being
+    // sent from the other slot, then wait for that to complete: only one
+    // transmission can be in progress. Our own is checked next time.
+    uint16_t start = txSlotStart(txSlot);
+    txWrite(start, len);
+    if (txPending)
+        txComplete(txSlotStart(txSlot ^ 1), txPendingLen);
+    txStart(start, len);
+
+    txPending = true;
+    txPendingLen = len;
+    txSlot ^= 1;
+#else
+    uint16_t start = txSlotStart(0);
+    txWrite(start, len);
+    txStart(start, len);
+    txComplete(start, len);
+#endif
+}
+
+bool ENC28J60::packetSendIdle() {
+#if ETHERCARD_SEND_PIPELINING
+    if (!txPending)
+        return true;
+    if (readRegByte(ECON1) & ECON1_TXRTS)
+        return false;
+    txComplete(txSlotStart(txSlot ^ 1), txPendingLen);
+    txPending = false;
+#endif
+    return true;
+}
+
 
 uint16_t ENC28J60::packetReceive() {
     static uint16_t gNextPacketPtr = RXSTART_INIT;
@@ -539,7 +581,10 @@ uint16_t ENC28J60::packetReceive() {
             uint16_t status;
         } header;
 
-        readBuf(sizeof header, (byte*) &header);
+        // header and frame in one chip select, ERDPT auto-increments
+        enableChip();
+        SPI.transfer(ENC28J60_READ_BUF_MEM);
+        SPI.transfer((byte*) &header, sizeof header);
 
         gNextPacketPtr  = header.nextPacket;
         len = header.byteCount - 4; //remove the CRC count
@@ -547,8 +592,9 @@ uint16_t ENC28J60::packetReceive() {
             len=bufferSize-1;
         if ((header.status & 0x80)==0)
             len = 0;
-        else
-            readBuf(len, buffer);
+        else if (len != 0)
+            SPI.transfer(buffer, len);
+        disableChip();
         buffer[len] = 0;
         unreleasedPacket = true;
 
@@ -22,11 +22,30 @@
 #define RXSTART_INIT        0x0000  // start of RX buffer, (must be zero, Rev. B4 Errata point 5)
 #define RXSTOP_INIT         0x0BFF  // end of RX buffer, room for 2 packets
  
-#define TXSTART_INIT        0x0C00  // start of TX buffer, room for 1 packet
-#define TXSTOP_INIT         0x11FF  // end of TX buffer
+/** Enable pipelining of packet transmissions.
+*   If enabled the TX buffer holds two slots. packetSend copies the frame into the
+*   free slot while the previous frame may still be on the wire, and only then waits
+*   for that one to complete (usually it has) before starting the new one. It returns
+*   without waiting for its own frame. With ETHERCARD_RETRY_LATECOLLISIONS a frame
+*   lost to a (false) late collision is retried from its slot on the next packetSend
+*   or packetSendIdle. Costs 1.5 Kb of the scratch area.
+*/
+#ifndef ETHERCARD_SEND_PIPELINING
+#define ETHERCARD_SEND_PIPELINING 1
+#endif
+
+#if ETHERCARD_SEND_PIPELINING
+#define TX_SLOTS            2
+#else
+#define TX_SLOTS            1
+#endif
+
+#define TXSTART_INIT        0x0C00  // start of TX buffer, room for 1 packet per slot
+#define TXSTOP_INIT         0x11FF  // end of the first TX slot
+#define TX_SLOT_SIZE        0x0600  // control byte, 1518 byte frame, 7 byte status vector
 
-#define SCRATCH_START       0x1200  // start of scratch area
-#define SCRATCH_LIMIT       0x2000  // past end of area, i.e. 3 Kb
+#define SCRATCH_START       (TXSTART_INIT + TX_SLOTS * TX_SLOT_SIZE)  // start of scratch area
+#define SCRATCH_LIMIT       0x2000  // past end of area, i.e. 3.5 Kb or 2 Kb pipelined
 #define SCRATCH_PAGE_SHIFT  6       // addressing is in pages of 64 bytes
 #define SCRATCH_PAGE_SIZE   (1 << SCRATCH_PAGE_SHIFT)
 #define SCRATCH_PAGE_NUM    ((SCRATCH_LIMIT-SCRATCH_START) >> SCRATCH_PAGE_SHIFT)
@@ -68,10 +87,18 @@ public:
 
     /**   @brief  Sends data to network interface
     *     @param  len Size of data to send
-    *     @note   Data buffer is shared by recieve and transmit functions
+    *     @note   Data buffer is shared by recieve and transmit functions, the frame
+    *             has been copied to the chip when this returns
     */
     static void packetSend (uint16_t len);
 
+    /**   @brief  Check whether the last frame sent has left the chip
+    *     @return <i>bool</i> True if no transmission is pending
+    *     @note   Cheap enough to call from a timer or on the INT line; with
+    *             ETHERCARD_SEND_PIPELINING it also finishes (or retries) that frame
+    */
+    static bool packetSendIdle ();
+
     /**   @brief  Copy recieved packets to data buffer
     *     @return <i>uint16_t</i> Size of recieved data
     *     @note   Data buffer is shared by recieve and transmit functions
@@ -197,13 +224,4 @@ typedef ENC28J60 Ethernet; //!< Define alias Ethernet for ENC28J60
 */
 #define ETHERCARD_RETRY_LATECOLLISIONS 0
 
-/** Enable pipelining of packet transmissions.
-*   If enabled the packetSend function will not block/wait until the packet is actually
-*   transmitted; but instead this wait is shifted to the next time that packetSend is
-*   called. This gives higher performance; however in combination with 
-*   ETHERCARD_RETRY_LATECOLLISIONS this may lead to problems because a packet whose
-*   transmission fails because the ENC-chip thinks that it is a late collision will
-*   not be retried until the next call to packetSend.
-*/
-#define ETHERCARD_SEND_PIPELINING 0
 #endif
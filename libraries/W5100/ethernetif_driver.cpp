@@ -25,16 +25,13 @@ extern "C" {
 #endif
 
 #include "ethernetif.h"
+#include "ethernetif_driver.h"
 #include "lowlevel_skeleton.h"
 
 /* Define those to better describe your network interface. */
 #define IFNAME0 'e'
 #define IFNAME1 'n'
 
-#ifndef ETHERNETIF_MAXFRAMES
-#define ETHERNETIF_MAXFRAMES 1
-#endif
-
 /**
  * This function should be called when a packet is ready to be read
  * from the interface. It uses the function low_level_input() that
@@ -42,9 +39,13 @@ extern "C" {
  * interface. Then the type of the received packet is determined and
  * the appropriate input function is called.
  *
+ * Frames waiting in the chip are taken, at most ETHERNETIF_MAXFRAMES
+ * of them when that is set; the caller polls again for the rest.
+ *
  * @param netif the lwip network interface structure for this ethernetif
+ * @return the number of frames taken from the chip
  */
-void
+int
 ethernetif_input(struct netif *netif)
 {
   struct ethernetif *ethernetif;
@@ -56,7 +57,7 @@ ethernetif_input(struct netif *netif)
   if (system_get_free_heap_size() < 5000)
   {
     //Serial.println("Out of memory");
-    return;
+    return 0;
   }
 
   ethernetif = (struct ethernetif *)netif->state;
@@ -113,7 +114,7 @@ ethernetif_input(struct netif *netif)
       low_level_input_nomem(ethernetif->internals, len);
       LINK_STATS_INC(link.memerr);
       LINK_STATS_INC(link.drop);
-      return;
+      return frames;
     }
     /* points to packet payload, which starts with an Ethernet header */
     ethhdr = (eth_hdr*)p->payload;
@@ -141,7 +142,10 @@ ethernetif_input(struct netif *netif)
       p = NULL;
       break;
     }
-  } while((!ETHERNETIF_MAXFRAMES) || (++frames < ETHERNETIF_MAXFRAMES));
+    frames++;
+  } while((!ETHERNETIF_MAXFRAMES) || (frames < ETHERNETIF_MAXFRAMES));
+
+  return frames;
 }   
           
 /**
@@ -40,5 +40,11 @@ This is how it works:
   Finally, whith the frame in the buffer, it will call netif->input.
  */
 
-void ethernetif_input(struct netif *netif);
+/* A flood of small frames must not keep the input loop, and with it the
+ * radio timers, busy for long: take a few per call, the poll comes back */
+#ifndef ETHERNETIF_MAXFRAMES
+#define ETHERNETIF_MAXFRAMES 8
+#endif
+
+int ethernetif_input(struct netif *netif);
 err_t ethernetif_init(struct netif *netif);
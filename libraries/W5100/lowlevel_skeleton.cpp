@@ -40,6 +40,16 @@ low_level_init(void *i, uint8_t *addr, void *mcast)
     SPI.endTransaction();
     W5100.writeSnMR(s, SnMR::MACRAW); 
     W5100.execCmdSn(s, Sock_OPEN);
+#ifdef ETHERNET_INT_PIN
+    /* INT goes low while the socket has unacknowledged received data */
+#if defined(W5500_ETHERNET_SHIELD)
+    W5100.writeSnIMR(s, SnIR::RECV);
+    W5100.writeSIMR(1 << s);
+#else
+    W5100.writeIMR(1 << s);
+#endif
+    pinMode(ETHERNET_INT_PIN, INPUT);
+#endif
     Serial.println("W5100 initialized.");
 #endif
 }
@@ -101,6 +111,53 @@ low_level_endoutput(void *i, uint16_t total_len)
     W5100.execCmdSn(s, Sock_SEND_MAC);
 #endif	
 }
+/*
+ * Receive state. In MACRAW mode each frame in the socket's RX buffer is
+ * preceded by a 2 byte length (which counts itself). The read pointer is
+ * kept here and only written back, together with the RECV command that
+ * frees the space, once everything the chip reported has been read. A
+ * frame is read together with the length header of the next one.
+ */
+#if WIRED_ETHERNET_MODE != WIRED_ETHERNET_NONE
+static bool     rxPointerValid = false;
+static uint16_t rxPointer;      // next byte to read
+static uint16_t rxUnread;       // reported by Sn_RX_RSR and not read yet
+static uint16_t rxUnreleased;   // read but not released to the chip yet
+static uint16_t rxNextLength;   // header of the frame at rxPointer, 0 if not read
+static uint16_t rxFrameLeft;    // of the frame being read into pbufs
+
+static void
+rx_release(void)
+{
+    W5100.writeSnRX_RD(s, rxPointer);
+    W5100.execCmdSn(s, Sock_RECV);
+    rxUnreleased = 0;
+}
+
+static void
+rx_skip(uint16_t len)
+{
+    rxPointer += len;
+    rxUnread -= len;
+    rxUnreleased += len;
+}
+
+/* Asks the chip how much arrived that has not been read yet */
+static void
+rx_refresh(void)
+{
+    if (rxUnreleased > 0 && rxUnread == 0)
+        rx_release();
+
+    rxUnread = W5100.getRXReceivedSize(s) - rxUnreleased;
+    if (!rxPointerValid)
+    {
+        rxPointer = W5100.readSnRX_RD(s);
+        rxPointerValid = true;
+    }
+}
+#endif
+
 /**
  * This function checks for a packet on the chip, and returns its length
  * @param ethernetif the lwip network interface structure for this netif
@@ -110,71 +167,57 @@ int
 low_level_startinput(void *i)
 {
 #if WIRED_ETHERNET_MODE != WIRED_ETHERNET_NONE
-    uint8_t header[8];
-    int rxLen;
+    uint8_t header[2];
     int pktLen;
 
-    /*
-     * Check the size of the RX buffer, It should hold at least the Wiznet
-     * header (2B) and a minimum ethernet header (14B).
-     */
-    rxLen = W5100.getRXReceivedSize(s);
-    if (rxLen < 16)
-        return 0;
-
-    //Serial.printf("buffer: %d bytes\n", rxLen);
-
-    /* Peek the header added by the Wiznet chip (2B) and the DST MAC (6B) */
-    W5100.recv_data_processing(s, header, 8, true);
-
-    /* Calculate the length of the packet we're going to retrieve */
-    pktLen = (header[0] << 8) + header[1];
+    if (rxNextLength == 0)
+    {
+        if (rxUnread == 0)
+            rx_refresh();
+        if (rxUnread == 0)
+            return 0;
+        if (rxUnread < 2)
+            goto corrupt;
 
-    /* Dump length and DST MAC
-    Serial.printf("header: %d [%02x %02x]\n", pktLen, header[0], header[1]);
-    Serial.printf("DST MAC: %02x:%02x:%02x:%02x:%02x:%02x\n",
-                  header[2], header[3], header[4],
-                  header[5], header[6], header[7]);*/
+        W5100.read_data(s, rxPointer, header, 2);
+        rx_skip(2);
+        rxNextLength = (header[0] << 8) + header[1];
+    }
 
     /*
-     * If the packet is maller than 16 bytes there is something wrong. At
-     * least 16 bytes need to be present (2B Wiznet header, 14B minimal
-     * ethernet header.
-     * When the packet exceeds the MTU by more than 16 bytes, there is also
-     * a problem with the packet.
-     * In both cases treat the whole buffer as a packet hoping next rx will
-     * be a sane one again.
+     * At least 16 bytes need to be present (2B Wiznet header, 14B minimal
+     * ethernet header) and at most the MTU plus those.
      */
+    pktLen = rxNextLength;
     if (pktLen < 16 ||
         pktLen > (2 + 14 + ETHERNET_MTU))
-    {
-        /* Probably corrupted, treat buffer as one packet */
-        W5100.recv_data_processing(s, header, 2);
-        W5100.execCmdSn(s, Sock_RECV);
-        Serial.printf("RX (corrupt?) packet: %d bytes, buffer %d bytes\n",
-                      pktLen - 2, rxLen - 2);
-        return rxLen - 2;
-    }
+        goto corrupt;
 
-    if (rxLen >= pktLen)
-    {
-        /* The whole packet is in the buffer */
-        W5100.recv_data_processing(s, header, 2);
-        W5100.execCmdSn(s, Sock_RECV);
-        //Serial.printf("RX packet: %d bytes\n", pktLen - 2);
-        return pktLen - 2;
-    }
+    /* The chip reports whole frames, a short one means we lost track */
+    if (rxUnread < pktLen - 2)
+        rx_refresh();
+    if (rxUnread < pktLen - 2)
+        goto corrupt;
 
-    /* The packet is not fully in the buffer, process whatever is available */
-    W5100.recv_data_processing(s, header, 2);
-    W5100.execCmdSn(s, Sock_RECV);
-    Serial.printf("RX (incomplete?) packet: %d bytes\n", rxLen - 2);
-    return rxLen - 2;
+    rxNextLength = 0;
+    rxFrameLeft = pktLen - 2;
+    return pktLen - 2;
+
+corrupt:
+    /* Drop everything received and start over at the next frame */
+    Serial.printf("RX corrupt? header %d, %d bytes dropped\n",
+                  rxNextLength, rxUnread);
+    rx_skip(rxUnread);
+    rx_release();
+    rxNextLength = 0;
 #endif
+    return 0;
 }
 
 /**
  * This function takes the data from the chip and copies it to a chained pbuf
+ * The last block of a frame is read together with the header of the
+ * next frame when the chip has one.
  * @param ethernetif the lwip network interface structure for this netif
  * @param data where the data is
  * @param len the block size
@@ -183,18 +226,20 @@ void
 low_level_input(void *i, void *data, uint16_t len)
 {
 #if WIRED_ETHERNET_MODE != WIRED_ETHERNET_NONE
-    W5100.recv_data_processing(s, (uint8_t*)data, len);
-    W5100.execCmdSn(s, Sock_RECV);
+    uint8_t header[2];
 
-    /*Serial.printf("INPUT: %d bytes, read into %x\n",
-                  len, (unsigned int)(data));
-    for (int i=0; i<len; i++)
+    rxFrameLeft -= len;
+    if (rxFrameLeft == 0 && rxUnread >= len + 2)
     {
-        uint8_t*arr = (uint8_t*)data;
-        Serial.print(arr[i], HEX);
-        Serial.print(" ");  
+        W5100.read_data(s, rxPointer, (uint8_t*)data, len, header, 2);
+        rx_skip(len + 2);
+        rxNextLength = (header[0] << 8) + header[1];
+    }
+    else
+    {
+        W5100.read_data(s, rxPointer, (uint8_t*)data, len);
+        rx_skip(len);
     }
-    Serial.print("\n");*/
 #endif 
 }
 
@@ -204,10 +249,21 @@ low_level_input(void *i, void *data, uint16_t len)
  */
 void
 low_level_endinput(void *i)
+{
+    /* The buffer space is released in batches, see rx_refresh() */
+}
+
+/**
+ * This function acknowledges the receive interrupt, so the INT line goes
+ * up until the next frame arrives. Call it before draining the chip: a
+ * frame arriving meanwhile raises the interrupt again.
+ * @param ethernetif the lwip network interface structure for this netif
+ */
+void
+low_level_ackinput(void *i)
 {
 #if WIRED_ETHERNET_MODE != WIRED_ETHERNET_NONE
-    //Serial.println("===> low_level_endinput");
-    //W5100.execCmdSn(s, Sock_RECV);
+    W5100.writeSnIR(s, SnIR::RECV);
 #endif
 }
 
@@ -222,6 +278,11 @@ low_level_endinput(void *i)
 void
 low_level_input_nomem(void *i, uint16_t len)
 {
-    Serial.println("===> low_level_input_nomem");
+#if WIRED_ETHERNET_MODE != WIRED_ETHERNET_NONE
+    /* Drop it, lwIP would not get to the frames behind it either */
+    rx_skip(len);
+    rx_release();
+    rxFrameLeft = 0;
+#endif
 }
 
@@ -8,6 +8,7 @@ void low_level_endoutput(void *i, uint16_t total_len);
 int low_level_startinput(void *i);
 void low_level_input(void *i, void *data, uint16_t len);
 void low_level_endinput(void *i);
+void low_level_ackinput(void *i);
 void low_level_input_nomem(void *i, uint16_t len);
 
 
@@ -137,6 +137,13 @@ void W5100Class::read_data(SOCKET s, volatile uint16_t src, volatile uint8_t *ds
     read(src_ptr, (uint8_t *) dst, len);
 }
 
+void W5100Class::read_data(SOCKET s, uint16_t src, uint8_t *dst, uint16_t len,
+                           uint8_t *next, uint16_t nextLen)
+{
+  read_data(s, src, dst, len);
+  read_data(s, src + len, next, nextLen);
+}
+
 
 uint8_t W5100Class::write(uint16_t _addr, uint8_t _data)
 {
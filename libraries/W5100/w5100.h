@@ -170,6 +170,14 @@ public:
    * the Rx memory uper-bound of socket.
    */
   void read_data(SOCKET s, volatile uint16_t src, volatile uint8_t * dst, uint16_t len);
+
+  /**
+   * @brief	Reads len bytes at src into dst and the nextLen bytes after them
+   * into next. The W5100 has no burst mode, so this is two reads. The
+   * read pointer is not touched.
+   */
+  void read_data(SOCKET s, uint16_t src, uint8_t *dst, uint16_t len,
+                 uint8_t *next, uint16_t nextLen);
   
   /**
    * @brief	 This function is being called by send() and sendto() function also. 
@@ -6,6 +6,7 @@
 
 #include "ethernetif.h"
 #include "ethernetif_driver.h"
+#include "lowlevel_skeleton.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -53,13 +54,111 @@ struct ip_addr myip_addr = {0x00000000UL};
 struct ip_addr gw_addr   = {0x00000000UL};
 struct ip_addr netmask   = {0x00000000UL};
 
-Timer ethTimer;
-void ethTimerHandler()
+/*
+ * Frames are fetched from the chip by ethTimer. With ETHERNET_INT_PIN
+ * the timer only samples the INT line, SPI is used once the chip pulls
+ * it low, plus a safety poll every ETH_SAFETY_POLL_MS. Without it the RX
+ * size register is polled: every ETH_POLL_MIN_US while frames come in,
+ * doubling the interval after each empty poll up to ETH_POLL_MAX_US.
+ * A wakeup takes at most ETHERNETIF_MAXFRAMES frames; when it hits that
+ * the next one follows after ETH_POLL_MIN_US whatever the INT line says,
+ * since the interrupt for the frames left behind is already acknowledged.
+ *
+ * Savings are counted against polling every ETH_POLL_MIN_US, where an
+ * empty poll costs ETH_POLL_SPI_TRANSACTIONS.
+ */
+#define ETH_POLL_MIN_US           500
+#define ETH_POLL_MAX_US           16000
+#define ETH_SAFETY_POLL_MS        1000
+#if WIRED_ETHERNET_MODE == WIRED_ETHERNET_W5500
+#define ETH_POLL_SPI_TRANSACTIONS 1     // Sn_RX_RSR in one burst
+#else
+#define ETH_POLL_SPI_TRANSACTIONS 2     // Sn_RX_RSR a byte at a time
+#endif
+
+static struct
 {
+    uint32_t wakeups;       // times the chip was asked for frames
+    uint32_t busyWakeups;   // ... and had some
+    uint32_t frames;
+    uint32_t maxFrames;     // most frames in one wakeup
+    int32_t  spiSaved;      // transactions not done
+} ethStats;
+
+static int ethDrain()
+{
+    int frames;
+
     if (netif_default != &w5100_netif)
         netif_set_default(&w5100_netif);
 
-    ethernetif_input(&w5100_netif);
+    frames = ethernetif_input(&w5100_netif);
+
+    ethStats.wakeups++;
+    if (frames > 0)
+    {
+        ethStats.busyWakeups++;
+        ethStats.frames += frames;
+        if (frames > ethStats.maxFrames)
+            ethStats.maxFrames = frames;
+    }
+    return frames;
+}
+
+Timer ethTimer;
+
+#ifdef ETHERNET_INT_PIN
+static uint32_t ethLastPoll = 0;
+static bool ethMoreFrames = false;   // last wakeup stopped at the cap
+
+void ethTimerHandler()
+{
+    if (digitalRead(ETHERNET_INT_PIN) == LOW)
+    {
+        low_level_ackinput(w5100_netif_if.internals);
+        ethStats.spiSaved--;    // the acknowledge is extra
+    }
+    else if (!ethMoreFrames && millis() - ethLastPoll < ETH_SAFETY_POLL_MS)
+    {
+        ethStats.spiSaved += ETH_POLL_SPI_TRANSACTIONS;
+        return;
+    }
+
+    ethLastPoll = millis();
+    int frames = ethDrain();
+    ethMoreFrames = ETHERNETIF_MAXFRAMES && frames >= ETHERNETIF_MAXFRAMES;
+}
+#else
+static uint32_t ethPollUs = ETH_POLL_MIN_US;
+
+void ethTimerHandler()
+{
+    if (ethDrain() > 0)
+        ethPollUs = ETH_POLL_MIN_US;
+    else if (ethPollUs < ETH_POLL_MAX_US)
+        ethPollUs *= 2;
+
+    ethStats.spiSaved += (ethPollUs / ETH_POLL_MIN_US - 1) *
+                         ETH_POLL_SPI_TRANSACTIONS;
+    ethTimer.initializeUs(ethPollUs, ethTimerHandler).startOnce();
+}
+#endif
+
+void w5100_netif_print(CommandOutput* out)
+{
+#ifdef ETHERNET_INT_PIN
+    out->printf("Wired RX mode      : INT on GPIO%d\n", ETHERNET_INT_PIN);
+#else
+    out->printf("Wired RX mode      : polled every %lu us\n", ethPollUs);
+#endif
+    out->printf("Wired RX frames    : %lu in %lu of %lu wakeups (max %lu)\n",
+                ethStats.frames, ethStats.busyWakeups, ethStats.wakeups,
+                ethStats.maxFrames);
+    if (ethStats.busyWakeups)
+        out->printf("Wired RX per wakeup: %lu.%02lu frames\n",
+                    ethStats.frames / ethStats.busyWakeups,
+                    ethStats.frames * 100 / ethStats.busyWakeups % 100);
+    out->printf("Wired SPI saved    : %ld transactions\n", ethStats.spiSaved);
 }
 
 void w5100_show_interfaces()
@@ -92,7 +191,11 @@ void w5100_netif_init()
     //netif_set_up(&w5100_netif);
     dhcp_start(&w5100_netif);
 
-    ethTimer.initializeUs(500, ethTimerHandler).start(true);
+#ifdef ETHERNET_INT_PIN
+    ethTimer.initializeUs(ETH_POLL_MIN_US, ethTimerHandler).start(true);
+#else
+    ethTimer.initializeUs(ETH_POLL_MIN_US, ethTimerHandler).startOnce();
+#endif
 }
 
 IPAddress w5100_netif_get_ip()
@@ -16,6 +16,9 @@
 // W5500 controller instance
 W5500Class W5100;
 
+// The ESP8266 SPI unit moves up to 64 bytes per transfer (SPI_W0..W15)
+#define W5500_SPI_FIFO_SIZE 64
+
 void W5500Class::init(void)
 {
     delay(1000);
@@ -101,6 +104,24 @@ void W5500Class::read_data(SOCKET s, volatile uint16_t src, volatile uint8_t *ds
     read((uint16_t)src , cntl_byte, (uint8_t *)dst, len);
 }
 
+void W5500Class::read_data(SOCKET s, uint16_t src, uint8_t *dst, uint16_t len,
+                           uint8_t *next, uint16_t nextLen)
+{
+    uint8_t cntl_byte = (0x18+(s<<5));
+#if defined(ARDUINO_ARCH_AVR)
+    setSS();
+    SPI.transfer(src >> 8);
+    SPI.transfer(src & 0xFF);
+    SPI.transfer(cntl_byte);
+    SPI.transfer(dst, len);
+    SPI.transfer(next, nextLen);
+    resetSS();
+#else
+    read(src, cntl_byte, dst, len);
+    read(src + len, cntl_byte, next, nextLen);
+#endif
+}
+
 uint8_t W5500Class::write(uint16_t _addr, uint8_t _cb, uint8_t _data)
 {
 #if defined(ARDUINO_ARCH_AVR)
@@ -122,12 +143,17 @@ uint8_t W5500Class::write(uint16_t _addr, uint8_t _cb, uint8_t _data)
 uint16_t W5500Class::write(uint16_t _addr, uint8_t _cb, const uint8_t *_buf, uint16_t _len)
 {
 #if defined(ARDUINO_ARCH_AVR)
+    // The transfer is full duplex and overwrites its buffer, so the data
+    // goes out through a copy, a FIFO (64 bytes) at a time
+    uint8_t fifo[W5500_SPI_FIFO_SIZE];
     setSS();
     SPI.transfer(_addr >> 8);
     SPI.transfer(_addr & 0xFF);
     SPI.transfer(_cb);
-    for (uint16_t i=0; i<_len; i++){
-        SPI.transfer(_buf[i]);
+    for (uint16_t i=0; i<_len; i+=W5500_SPI_FIFO_SIZE){
+        uint16_t n = _len - i < W5500_SPI_FIFO_SIZE ? _len - i : W5500_SPI_FIFO_SIZE;
+        memcpy(fifo, _buf + i, n);
+        SPI.transfer(fifo, n);
     }
     resetSS();
 #else
@@ -169,9 +195,8 @@ uint16_t W5500Class::read(uint16_t _addr, uint8_t _cb, uint8_t *_buf, uint16_t _
     SPI.transfer(_addr >> 8);
     SPI.transfer(_addr & 0xFF);
     SPI.transfer(_cb);
-    for (uint16_t i=0; i<_len; i++){
-        _buf[i] = SPI.transfer(0);
-    }
+    // What is clocked out during the data phase is ignored
+    SPI.transfer(_buf, _len);
     resetSS();
 #else
   uint16_t i;
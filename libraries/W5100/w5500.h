@@ -131,6 +131,14 @@ public:
    * the Rx memory uper-bound of socket.
    */
   void read_data(SOCKET s, volatile uint16_t  src, volatile uint8_t * dst, uint16_t len);
+
+  /**
+   * @brief	Reads len bytes at src into dst and the nextLen bytes after them
+   * into next, in one SPI frame. Used to fetch a frame together with the
+   * length header of the one behind it. The read pointer is not touched.
+   */
+  void read_data(SOCKET s, uint16_t src, uint8_t *dst, uint16_t len,
+                 uint8_t *next, uint16_t nextLen);
   
   /**
    * @brief	 This function is being called by send() and sendto() function also. 
@@ -226,6 +234,8 @@ public:
   __GP_REGISTER_N(SIPR,   0x000F, 4); // Source IP address
   __GP_REGISTER8 (IR,     0x0015);    // Interrupt
   __GP_REGISTER8 (IMR,    0x0016);    // Interrupt Mask
+  __GP_REGISTER8 (SIR,    0x0017);    // Socket Interrupt
+  __GP_REGISTER8 (SIMR,   0x0018);    // Socket Interrupt Mask
   __GP_REGISTER16(RTR,    0x0019);    // Timeout address
   __GP_REGISTER8 (RCR,    0x001B);    // Retry count
   __GP_REGISTER_N(UIPR,   0x0028, 4); // Unreachable IP address in UDP mode
@@ -270,15 +280,16 @@ private:
     return res;                                              \
   }
 #else
+// Both bytes in one SPI frame, the W5500 increments the address itself
 #define __SOCKET_REGISTER16(name, address)                   \
   static void write##name(SOCKET _s, uint16_t _data) {       \
-    writeSn(_s, address,   _data >> 8);                      \
-    writeSn(_s, address+1, _data & 0xFF);                    \
+    uint8_t buf[2] = { (uint8_t)(_data >> 8), (uint8_t)_data }; \
+    writeSn(_s, address, buf, 2);                            \
   }                                                          \
   static uint16_t read##name(SOCKET _s) {                    \
-    uint16_t res = readSn(_s, address);                      \
-    res = (res << 8) + readSn(_s, address + 1);              \
-    return res;                                              \
+    uint8_t buf[2];                                          \
+    readSn(_s, address, buf, 2);                             \
+    return (buf[0] << 8) + buf[1];                           \
   }
 #endif  
 #define __SOCKET_REGISTER_N(name, address, size)             \
@@ -308,6 +319,7 @@ public:
   __SOCKET_REGISTER16(SnRX_RSR,   0x0026)        // RX Free Size
   __SOCKET_REGISTER16(SnRX_RD,    0x0028)        // RX Read Pointer
   __SOCKET_REGISTER16(SnRX_WR,    0x002A)        // RX Write Pointer (supported?)
+  __SOCKET_REGISTER8(SnIMR,       0x002C)        // Interrupt Mask
   
 #undef __SOCKET_REGISTER8
 #undef __SOCKET_REGISTER16